@@ -21,6 +21,8 @@ struct Shape {
 
 struct Uniform {
     viewport: vec2<f32>,
+    // World position at the center of the viewport
+    camera: vec2<f32>,
 }
 
 @group(0) @binding(0) 
@@ -91,7 +93,7 @@ fn vs_main(v: Vertex) -> VertexOutput {
     out.index = shape.index;
     out.uv = vertex.xy * out.size * uv_ratio;
     out.texture_uv = (vertex.xy + 1.0) / 2.0;
-    out.clip_position = vec4<f32>((rotated_vertex.xy + shape.position.xy * 2.0) / uniforms.viewport, 0.0, 1.0);
+    out.clip_position = vec4<f32>((rotated_vertex.xy + (shape.position.xy - uniforms.camera) * 2.0) / uniforms.viewport, 0.0, 1.0);
 
     return out;
 }
@@ -0,0 +1,61 @@
+struct Vertex {
+	@builtin(vertex_index) index: u32,
+	@builtin(instance_index) instance: u32,
+}
+
+struct VertexOutput {
+	@builtin(position) clip_position: vec4<f32>,
+	@location(0) color: vec4<f32>,
+}
+
+struct Line {
+	// Start and end point in world units
+	points: vec4<f32>,
+	color: vec4<f32>,
+	// Width in pixels, zero length lines are drawn as squares of this size
+	width: f32,
+}
+
+struct Uniform {
+    viewport: vec2<f32>,
+    // World position at the center of the viewport
+    camera: vec2<f32>,
+}
+
+@group(0) @binding(0)
+var<uniform> uniforms: Uniform;
+
+@group(1) @binding(0)
+var<storage> lines: array<Line>;
+
+@vertex
+fn vs_main(v: Vertex) -> VertexOutput {
+    var out: VertexOutput;
+
+    let line = lines[v.instance];
+    let start = line.points.xy;
+    let end = line.points.zw;
+    let delta = end - start;
+    let len = length(delta);
+    let direction = select(vec2<f32>(1.0, 0.0), delta / len, len > 0.0);
+    let normal = vec2<f32>(-direction.y, direction.x);
+
+    // Triangle strip corners: (0, 1), (1, 1), (0, -1), (1, -1) along and across the line, the
+    // ends are extended by half the width so points and joints are covered
+    let along = f32(v.index & 1u);
+    let across = 1.0 - f32(v.index & 2u);
+    let half_width = line.width * 0.5;
+    let position = mix(start, end, along) + direction * (along * 2.0 - 1.0) * half_width +
+        normal * across * half_width;
+
+    out.color = line.color;
+    // In front of every layer so debug lines are never hidden
+    out.clip_position = vec4<f32>((position - uniforms.camera) * 2.0 / uniforms.viewport, 0.0, 1.0);
+
+    return out;
+}
+
+@fragment
+fn fs_main(f: VertexOutput) -> @location(0) vec4<f32> {
+    return f.color;
+}
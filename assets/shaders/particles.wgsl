@@ -0,0 +1,237 @@
+// Particle simulation. Particles live in fixed slots, free slots are kept on a stack and live
+// slots in two lists that swap every frame. Every live particle is also written to a Shape list
+// drawn by the quad shader, so the particle count never has to be read back.
+
+struct Particle {
+    position: vec2<f32>,
+    velocity: vec2<f32>,
+    age: f32,
+    lifetime: f32,
+    // Diameter at birth and at death
+    size: vec2<f32>,
+    color_start: u32,
+    color_end: u32,
+    gravity: f32,
+    drag: f32,
+    layer: f32,
+}
+
+// Matches Shape in quad.wgsl
+struct Shape {
+    color: vec4<f32>,
+    corner_radii: vec4<f32>,
+    position: vec4<f32>,
+    size: vec2<f32>,
+    id: u32,
+}
+
+struct State {
+    // Free slots, may drop below zero for a moment while emitting into a full buffer
+    dead_count: atomic<i32>,
+    alive_count: array<atomic<u32>, 2>,
+    // Live list read by this frame's simulate, the other one is written
+    current: u32,
+}
+
+// Indirect arguments for drawing the shapes and for the next frame's simulate
+struct Args {
+    vertex_count: u32,
+    instance_count: u32,
+    first_vertex: u32,
+    first_instance: u32,
+    workgroups_x: u32,
+    workgroups_y: u32,
+    workgroups_z: u32,
+}
+
+// Settings of every ParticleEmitter, only uploaded when they change
+struct EmitterParams {
+    // Ranges particles pick from
+    speed: vec2<f32>,
+    lifetime: vec2<f32>,
+    size: vec2<f32>,
+    spread: f32,
+    gravity: f32,
+    drag: f32,
+    color_start: u32,
+    color_end: u32,
+}
+
+// Emitters releasing particles this frame
+struct Emitter {
+    position: vec2<f32>,
+    direction: f32,
+    layer: f32,
+    // Emit index of the first particle of this emitter
+    first: u32,
+    // Index into emitter_params
+    params: u32,
+}
+
+struct Params {
+    delta_time: f32,
+    capacity: u32,
+    emitter_count: u32,
+    emit_count: u32,
+    seed: u32,
+}
+
+@group(0) @binding(0) var<storage, read_write> particles: array<Particle>;
+@group(0) @binding(1) var<storage, read_write> dead: array<u32>;
+// Two lists of capacity slots each
+@group(0) @binding(2) var<storage, read_write> alive: array<u32>;
+@group(0) @binding(3) var<storage, read_write> state: State;
+@group(0) @binding(4) var<storage, read_write> shapes: array<Shape>;
+
+@group(1) @binding(0) var<uniform> params: Params;
+@group(1) @binding(1) var<storage, read> emitters: array<Emitter>;
+
+// Only bound for reset and finish, simulate reads it as its indirect dispatch
+@group(2) @binding(0) var<storage, read_write> args: Args;
+
+// Only bound for emit
+@group(3) @binding(0) var<storage, read> emitter_params: array<EmitterParams>;
+
+// PCG hash
+fn hash(value: u32) -> u32 {
+    let x = value * 747796405u + 2891336453u;
+    let word = ((x >> ((x >> 28u) + 4u)) ^ x) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Uniform in [0, 1]
+fn random(seed: ptr<function, u32>) -> f32 {
+    *seed = hash(*seed);
+    return f32(*seed) / 4294967295.0;
+}
+
+fn to_shape(p: Particle) -> Shape {
+    let t = saturate(p.age / p.lifetime);
+    let size = mix(p.size.x, p.size.y, t);
+
+    var shape: Shape;
+    shape.color = mix(unpack4x8unorm(p.color_start), unpack4x8unorm(p.color_end), t);
+    shape.corner_radii = vec4<f32>(size * 0.5);
+    shape.position = vec4<f32>(p.position, 0.0, p.layer);
+    shape.size = vec2<f32>(size);
+    // Particles can't be picked
+    shape.id = 0u;
+    return shape;
+}
+
+// Append a live particle to the list drawn this frame and simulated next frame
+fn keep(index: u32, p: Particle) {
+    let next = 1u - state.current;
+    let slot = atomicAdd(&state.alive_count[next], 1u);
+    alive[next * params.capacity + slot] = index;
+    shapes[slot] = to_shape(p);
+}
+
+// Free every slot, dispatched once after the buffers are created
+@compute @workgroup_size(64)
+fn reset(@builtin(global_invocation_id) id: vec3<u32>) {
+    if id.x == 0u {
+        atomicStore(&state.dead_count, i32(params.capacity));
+        atomicStore(&state.alive_count[0], 0u);
+        atomicStore(&state.alive_count[1], 0u);
+        state.current = 0u;
+
+        args.vertex_count = 4u;
+        args.instance_count = 0u;
+        args.first_vertex = 0u;
+        args.first_instance = 0u;
+        args.workgroups_x = 0u;
+        args.workgroups_y = 1u;
+        args.workgroups_z = 1u;
+    }
+    if id.x < params.capacity {
+        dead[id.x] = id.x;
+    }
+}
+
+// Age and move every live particle, expired ones return their slot
+@compute @workgroup_size(64)
+fn simulate(@builtin(global_invocation_id) id: vec3<u32>) {
+    let current = state.current;
+    if id.x >= atomicLoad(&state.alive_count[current]) {
+        return;
+    }
+
+    let index = alive[current * params.capacity + id.x];
+    var p = particles[index];
+    p.age += params.delta_time;
+    if p.age >= p.lifetime {
+        let slot = atomicAdd(&state.dead_count, 1);
+        dead[u32(slot)] = index;
+        return;
+    }
+
+    p.velocity.y += p.gravity * params.delta_time;
+    p.velocity *= max(1.0 - p.drag * params.delta_time, 0.0);
+    p.position += p.velocity * params.delta_time;
+    particles[index] = p;
+    keep(index, p);
+}
+
+// Last emitter whose first particle is at or before the emit index
+fn find_emitter(index: u32) -> u32 {
+    var low = 0u;
+    var high = params.emitter_count;
+    while high - low > 1u {
+        let middle = (low + high) / 2u;
+        if emitters[middle].first <= index {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// One invocation per particle emitted this frame
+@compute @workgroup_size(64)
+fn emit(@builtin(global_invocation_id) id: vec3<u32>) {
+    if id.x >= params.emit_count {
+        return;
+    }
+
+    // Take a free slot, particles emitted into a full buffer are dropped
+    let free = atomicSub(&state.dead_count, 1);
+    if free <= 0 {
+        atomicAdd(&state.dead_count, 1);
+        return;
+    }
+    let index = dead[u32(free - 1)];
+
+    let emitter = emitters[find_emitter(id.x)];
+    let settings = emitter_params[emitter.params];
+    var seed = hash(id.x ^ hash(params.seed));
+    let angle = emitter.direction + (random(&seed) * 2.0 - 1.0) * settings.spread;
+    let speed = mix(settings.speed.x, settings.speed.y, random(&seed));
+
+    var p: Particle;
+    p.position = emitter.position;
+    p.velocity = vec2<f32>(cos(angle), sin(angle)) * speed;
+    p.age = 0.0;
+    p.lifetime = max(mix(settings.lifetime.x, settings.lifetime.y, random(&seed)), 0.001);
+    p.size = settings.size;
+    p.color_start = settings.color_start;
+    p.color_end = settings.color_end;
+    p.gravity = settings.gravity;
+    p.drag = settings.drag;
+    p.layer = emitter.layer;
+    particles[index] = p;
+    keep(index, p);
+}
+
+// Swap the live lists and write the indirect arguments
+@compute @workgroup_size(1)
+fn finish() {
+    let next = 1u - state.current;
+    let count = atomicLoad(&state.alive_count[next]);
+    args.instance_count = count;
+    args.workgroups_x = (count + 63u) / 64u;
+
+    atomicStore(&state.alive_count[state.current], 0u);
+    state.current = next;
+}
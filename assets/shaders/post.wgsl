@@ -0,0 +1,67 @@
+// Bloom: the bright parts of the scene are extracted at half resolution, blurred horizontally and
+// vertically, then added back while the scene is copied into the surface.
+
+struct Params {
+    // Brightest channel where pixels start to glow, and the strength of the glow added back
+    threshold: f32,
+    strength: f32,
+}
+
+@group(0) @binding(0) var source: texture_2d<f32>;
+// Only sampled by the composite, the other steps bind the source twice
+@group(0) @binding(1) var glow: texture_2d<f32>;
+@group(0) @binding(2) var linear_sampler: sampler;
+@group(0) @binding(3) var<uniform> params: Params;
+
+struct VertexOutput {
+    @builtin(position) position: vec4<f32>,
+    @location(0) uv: vec2<f32>,
+}
+
+// One triangle covering the target, uv has its origin at the top left like the texture
+@vertex
+fn vs_main(@builtin(vertex_index) index: u32) -> VertexOutput {
+    let uv = vec2<f32>(f32((index << 1u) & 2u), f32(index & 2u));
+    var out: VertexOutput;
+    out.position = vec4<f32>(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, 0.0, 1.0);
+    out.uv = uv;
+    return out;
+}
+
+@fragment
+fn fs_bright(in: VertexOutput) -> @location(0) vec4<f32> {
+    let color = textureSample(source, linear_sampler, in.uv).rgb;
+    let brightness = max(color.r, max(color.g, color.b));
+    let weight = saturate((brightness - params.threshold) / max(1.0 - params.threshold, 0.001));
+    return vec4<f32>(color * weight, 1.0);
+}
+
+// 9 tap gaussian in 5 samples, linear filtering blends the taps between texels
+fn blur(uv: vec2<f32>, direction: vec2<f32>) -> vec4<f32> {
+    let texel = direction / vec2<f32>(textureDimensions(source));
+    let near = texel * 1.3846153846;
+    let far = texel * 3.2307692308;
+    var color = textureSample(source, linear_sampler, uv).rgb * 0.2270270270;
+    color += textureSample(source, linear_sampler, uv + near).rgb * 0.3162162162;
+    color += textureSample(source, linear_sampler, uv - near).rgb * 0.3162162162;
+    color += textureSample(source, linear_sampler, uv + far).rgb * 0.0702702703;
+    color += textureSample(source, linear_sampler, uv - far).rgb * 0.0702702703;
+    return vec4<f32>(color, 1.0);
+}
+
+@fragment
+fn fs_blur_x(in: VertexOutput) -> @location(0) vec4<f32> {
+    return blur(in.uv, vec2<f32>(1.0, 0.0));
+}
+
+@fragment
+fn fs_blur_y(in: VertexOutput) -> @location(0) vec4<f32> {
+    return blur(in.uv, vec2<f32>(0.0, 1.0));
+}
+
+@fragment
+fn fs_composite(in: VertexOutput) -> @location(0) vec4<f32> {
+    let scene = textureSample(source, linear_sampler, in.uv);
+    let bloom = textureSample(glow, linear_sampler, in.uv).rgb;
+    return vec4<f32>(scene.rgb + bloom * params.strength, scene.a);
+}
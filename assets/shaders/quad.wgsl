@@ -1,6 +1,6 @@
 struct Vertex {
+	@builtin(vertex_index) index: u32,
 	@builtin(instance_index) instance: u32,
-	@location(0) pos: vec3<f32>,
 }
 
 struct VertexOutput {
@@ -9,17 +9,22 @@ struct VertexOutput {
 	@location(1) uv: vec2<f32>,
 	@location(2) size: vec2<f32>,
 	@location(3) corner_radii: vec4<f32>,
+	@location(4) @interpolate(flat) id: u32,
 }
 
 struct Shape {
 	@location(0) color: vec4<f32>,
 	@location(1) corner_radii: vec4<f32>,
-	@location(2) position: vec3<f32>,
+	// x, y, rotation and layer
+	@location(2) position: vec4<f32>,
 	@location(3) size: vec2<f32>,
+	@location(4) id: u32,
 }
 
 struct Uniform {
     viewport: vec2<f32>,
+    // World position at the center of the viewport
+    camera: vec2<f32>,
 }
 
 @group(0) @binding(0) 
@@ -28,7 +33,14 @@ var<uniform> uniforms: Uniform;
 @group(1) @binding(0) 
 var<storage> shapes: array<Shape>;
 
-const AA_PADDING: f32 = 0.0;
+// Set by the pipeline for the selected anti-aliasing mode
+override AA_PADDING: f32 = 0.0;
+override ANALYTIC_AA: bool = false;
+
+// Higher layers are closer to the camera, layers within [-512, 512] map to distinct depths
+fn layer_depth(layer: f32) -> f32 {
+    return clamp(0.5 - layer / 1024.0, 0.0, 1.0);
+}
 
 // Given a position, and a size determine the distance between a point and the rectangle with those side lengths
 fn rectSDF(position: vec2<f32>, size: vec2<f32>) -> f32 {
@@ -62,7 +74,8 @@ fn quadrant(in: vec2<f32>) -> i32 {
 fn vs_main(v: Vertex) -> VertexOutput {
     var out: VertexOutput;
 
-    let vertex = v.pos;
+    // Triangle strip corners: (-1, 1), (1, 1), (-1, -1), (1, -1)
+    let vertex = vec2<f32>(f32(v.index & 1u) * 2.0 - 1.0, 1.0 - f32(v.index & 2u));
     let shape = shapes[v.instance];
 
     let shortest_side = min(shape.size.x, shape.size.y);
@@ -72,6 +85,7 @@ fn vs_main(v: Vertex) -> VertexOutput {
     // out.size = shape.size;
     out.corner_radii = 2.0 * min(shape.corner_radii / shortest_side, vec4<f32>(0.5));
     out.color = shape.color;
+    out.id = shape.id;
 
     let c = cos(-shape.position.z);
     let s = sin(-shape.position.z);
@@ -79,13 +93,13 @@ fn vs_main(v: Vertex) -> VertexOutput {
     let padded_vertex = scaled_vertex + sign(scaled_vertex) * AA_PADDING;
     let uv_ratio = padded_vertex / scaled_vertex;
     let rotated_vertex = vec2<f32>(
-        c * scaled_vertex.x + s * scaled_vertex.y,
-        c * scaled_vertex.y - s * scaled_vertex.x
+        c * padded_vertex.x + s * padded_vertex.y,
+        c * padded_vertex.y - s * padded_vertex.x
     );
 
     out.uv = vertex.xy * out.size * uv_ratio;
 
-    out.clip_position = vec4<f32>((rotated_vertex.xy + shape.position.xy * 2.0) / uniforms.viewport, 0.0, 1.0);
+    out.clip_position = vec4<f32>((rotated_vertex.xy + (shape.position.xy - uniforms.camera) * 2.0) / uniforms.viewport, layer_depth(shape.position.w), 1.0);
 
     return out;
 }
@@ -103,12 +117,28 @@ fn vs_main(v: Vertex) -> VertexOutput {
 //     return 1.0 - saturate(-value / pd);
 // }
 
-@ fragment
-fn fs_main(f: VertexOutput) -> @ location(0) vec4<f32> {
+// Signed distance to the shape edge in uv space
+fn shape_distance(f: VertexOutput) -> f32 {
     let quadrant = quadrant(f.uv);
     let radii = f.corner_radii[quadrant];
 
-    let dist = rectSDF(f.uv, f.size - radii) - radii;
+    return rectSDF(f.uv, f.size - radii) - radii;
+}
+
+// Fraction of the pixel covered by the shape, estimated from the screen space rate of change of
+// the distance. Keeps early depth testing intact since nothing is discarded.
+fn analytic_coverage(dist: f32) -> f32 {
+    let width = max(fwidth(dist), 0.00001);
+    return saturate(0.5 - dist / width);
+}
+
+fn shade(f: VertexOutput) -> vec4<f32> {
+    let dist = shape_distance(f);
+
+    if ANALYTIC_AA {
+        return vec4<f32>(f.color.rgb, f.color.a * analytic_coverage(dist));
+    }
+
     let in_shape = step(dist, 0.0);
     
     // let in_shape = step_aa(dist, 0.0);
@@ -120,7 +150,7 @@ fn fs_main(f: VertexOutput) -> @ location(0) vec4<f32> {
     // let filter_width = max(abs(dpdx(f.uv).x), abs(dpdy(f.uv).y));
     // let bias = (-dist + 0.5 * filter_width) / filter_width;
     // let in_shape = saturate(bias);
-    let color = vec4<f32>(f.color.rgb, in_shape);
+    let color = vec4<f32>(f.color.rgb, f.color.a * in_shape);
 
 
     if in_shape < 0.00001 {
@@ -128,4 +158,28 @@ fn fs_main(f: VertexOutput) -> @ location(0) vec4<f32> {
     }
 
     return color;
-}
\ No newline at end of file
+}
+
+@ fragment
+fn fs_main(f: VertexOutput) -> @ location(0) vec4<f32> {
+    return shade(f);
+}
+
+struct PickingOutput {
+    @location(0) color: vec4<f32>,
+    @location(1) id: u32,
+}
+
+// Used when the main pass has an entity id target
+@ fragment
+fn fs_picking(f: VertexOutput) -> PickingOutput {
+    var out: PickingOutput;
+    out.color = shade(f);
+    out.id = f.id;
+
+    // Padding added for analytic anti-aliasing must not be pickable
+    if ANALYTIC_AA && out.color.a <= 0.0 {
+        discard;
+    }
+    return out;
+}
@@ -0,0 +1,105 @@
+struct Vertex {
+	@builtin(vertex_index) index: u32,
+	@builtin(instance_index) instance: u32,
+}
+
+struct VertexOutput {
+	@builtin(position) clip_position: vec4<f32>,
+	@location(0) color: vec4<f32>,
+	@location(1) texture_uv: vec2<f32>,
+	@location(2) @interpolate(flat) layer: u32,
+	@location(3) @interpolate(flat) id: u32,
+}
+
+struct Sprite {
+	// Multiplied with the texture
+	color: vec4<f32>,
+	// Texture rect: left, top, right, bottom
+	uv: vec4<f32>,
+	// x, y, rotation and layer
+	position: vec4<f32>,
+	size: vec2<f32>,
+	// Layer of the texture array
+	texture_layer: u32,
+	id: u32,
+}
+
+struct Uniform {
+    viewport: vec2<f32>,
+    // World position at the center of the viewport
+    camera: vec2<f32>,
+}
+
+@group(0) @binding(0)
+var<uniform> uniforms: Uniform;
+
+@group(1) @binding(0)
+var<storage> sprites: array<Sprite>;
+
+@group(2) @binding(0)
+var texture: texture_2d_array<f32>;
+
+@group(2) @binding(1)
+var texture_sampler: sampler;
+
+// Higher layers are closer to the camera, layers within [-512, 512] map to distinct depths
+fn layer_depth(layer: f32) -> f32 {
+    return clamp(0.5 - layer / 1024.0, 0.0, 1.0);
+}
+
+@vertex
+fn vs_main(v: Vertex) -> VertexOutput {
+    var out: VertexOutput;
+
+    // Triangle strip corners: (-1, 1), (1, 1), (-1, -1), (1, -1)
+    let vertex = vec2<f32>(f32(v.index & 1u) * 2.0 - 1.0, 1.0 - f32(v.index & 2u));
+    let sprite = sprites[v.instance];
+
+    let c = cos(-sprite.position.z);
+    let s = sin(-sprite.position.z);
+    let scaled_vertex = vertex * sprite.size;
+    let rotated_vertex = vec2<f32>(
+        c * scaled_vertex.x + s * scaled_vertex.y,
+        c * scaled_vertex.y - s * scaled_vertex.x
+    );
+
+    // Top of the image at the top of the quad
+    let corner = vec2<f32>(vertex.x + 1.0, 1.0 - vertex.y) * 0.5;
+    out.texture_uv = mix(sprite.uv.xy, sprite.uv.zw, corner);
+    out.color = sprite.color;
+    out.layer = sprite.texture_layer;
+    out.id = sprite.id;
+    out.clip_position = vec4<f32>((rotated_vertex + (sprite.position.xy - uniforms.camera) * 2.0) / uniforms.viewport, layer_depth(sprite.position.w), 1.0);
+
+    return out;
+}
+
+fn shade(f: VertexOutput) -> vec4<f32> {
+    let color = textureSample(texture, texture_sampler, f.texture_uv, f.layer) * f.color;
+
+    // Fully transparent texels are neither drawn nor pickable
+    if color.a < 0.00001 {
+        discard;
+    }
+
+    return color;
+}
+
+@fragment
+fn fs_main(f: VertexOutput) -> @location(0) vec4<f32> {
+    return shade(f);
+}
+
+struct PickingOutput {
+    @location(0) color: vec4<f32>,
+    @location(1) id: u32,
+}
+
+// Used when the main pass has an entity id target
+@fragment
+fn fs_picking(f: VertexOutput) -> PickingOutput {
+    var out: PickingOutput;
+    out.color = shade(f);
+    out.id = f.id;
+    return out;
+}
@@ -0,0 +1,60 @@
+#include "allocations.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace allocations {
+
+static std::atomic<uint64_t> allocation_count{0};
+
+#ifdef COUNT_ALLOCATIONS
+bool enabled() { return true; }
+#else
+bool enabled() { return false; }
+#endif
+
+uint64_t count() { return allocation_count.load(std::memory_order_relaxed); }
+
+} // namespace allocations
+
+#ifdef COUNT_ALLOCATIONS
+// Array, nothrow and sized variants forward to these by default
+void *operator new(std::size_t size) {
+    allocations::allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+void *operator new(std::size_t size, std::align_val_t align) {
+    allocations::allocation_count.fetch_add(1, std::memory_order_relaxed);
+    std::size_t alignment = (std::size_t)align;
+#ifdef _WIN32
+    void *ptr = _aligned_malloc(size == 0 ? 1 : size, alignment);
+#else
+    // aligned_alloc requires the size to be a multiple of the alignment
+    void *ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    if (ptr != nullptr) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t align) noexcept {
+    operator delete(ptr, align);
+}
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counters. operator new is only replaced when built with COUNT_ALLOCATIONS, flecs
+// counts its own allocations through the OS API.
+namespace allocations {
+
+bool enabled();
+
+// Calls to operator new since startup
+uint64_t count();
+
+} // namespace allocations
@@ -0,0 +1,112 @@
+#include "bench.hpp"
+#include "../include.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace rendering;
+
+namespace aa_bench {
+
+int shape_count = 20000;
+int warmup_frames = 60;
+int measured_frames = 600;
+
+struct Mode {
+    AntiAliasing anti_aliasing;
+    const char *name;
+};
+
+std::array<Mode, 3> modes = {{
+    {AntiAliasing::None, "none (discard)"},
+    {AntiAliasing::Msaa4x, "4x MSAA"},
+    {AntiAliasing::Analytic, "analytic (fwidth)"},
+}};
+
+struct State {
+    size_t mode = 0;
+    int frame = 0;
+    double elapsed = 0.0;
+    std::chrono::steady_clock::time_point last;
+    std::array<double, 3> frame_times = {};
+};
+
+// Overlapping quads and circles without bodies, so only rendering cost differs between modes
+void spawn_shapes(flecs::world &world) {
+    std::mt19937 rng{42};
+    std::uniform_real_distribution<float> x(-320.0f, 320.0f);
+    std::uniform_real_distribution<float> y(-240.0f, 240.0f);
+    std::uniform_real_distribution<float> size(4.0f, 24.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    int half = shape_count / 2;
+    std::vector<Position> positions;
+    std::vector<Quad> quads;
+    std::vector<Circle> circles;
+    std::vector<Color> colors;
+    for (int i = 0; i < half; i++) {
+        positions.push_back({x(rng), y(rng), unit(rng) * 6.28f});
+        float width = size(rng);
+        quads.push_back({width, size(rng), unit(rng) * width * 0.5f});
+        circles.push_back({size(rng) * 0.5f});
+        colors.push_back({unit(rng), unit(rng), unit(rng), 1.0f});
+    }
+
+    spawn::ShapeDesc desc;
+    desc.count = half;
+    desc.positions = positions.data();
+    desc.colors = colors.data();
+    desc.quads = quads.data();
+    spawn::shapes(world, desc);
+
+    desc.quads = nullptr;
+    desc.circles = circles.data();
+    spawn::shapes(world, desc);
+}
+
+void select_mode(flecs::world &world, const Mode &mode) {
+    Settings settings = world.get<Settings>();
+    settings.anti_aliasing = mode.anti_aliasing;
+    settings.vsync = false;
+    world.set<Settings>(settings);
+}
+
+module::module(flecs::world &world) {
+    spawn_shapes(world);
+    select_mode(world, modes[0]);
+    world.set<State>({});
+
+    world.system<State>().kind(flecs::OnLoad).each([](flecs::entity e, State &state) {
+        flecs::world world = e.world();
+        auto now = std::chrono::steady_clock::now();
+        if (state.frame > warmup_frames) {
+            state.elapsed += std::chrono::duration<double, std::milli>(now - state.last).count();
+        }
+        state.last = now;
+
+        if (++state.frame <= warmup_frames + measured_frames) {
+            return;
+        }
+
+        state.frame_times[state.mode] = state.elapsed / measured_frames;
+        state.frame = 0;
+        state.elapsed = 0.0;
+
+        if (++state.mode < modes.size()) {
+            select_mode(world, modes[state.mode]);
+            return;
+        }
+
+        std::printf("Anti-aliasing benchmark, %d shapes, %d frames per mode\n", shape_count,
+                    measured_frames);
+        for (size_t i = 0; i < modes.size(); i++) {
+            std::printf("  %-20s %8.3f ms %8.1f fps\n", modes[i].name, state.frame_times[i],
+                        1000.0 / state.frame_times[i]);
+        }
+        world.quit();
+    });
+}
+
+} // namespace aa_bench
@@ -0,0 +1,103 @@
+#include "bench.hpp"
+#include "../rendering/atlas.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace rendering;
+
+namespace atlas_bench {
+
+uint32_t page_size = 2048;
+int pages = 200;
+
+struct Rect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Segments must cover the page left to right without gaps, and neighbours at the same height
+// must have been merged into one
+static bool skyline_valid(const SkylinePacker &packer) {
+    uint32_t x = 0;
+    for (size_t i = 0; i < packer.skyline.size(); i++) {
+        const SkylinePacker::Segment &segment = packer.skyline[i];
+        if (segment.x != x || segment.width == 0 || segment.y > packer.height) {
+            return false;
+        }
+        if (i > 0 && packer.skyline[i - 1].y == segment.y) {
+            return false;
+        }
+        x += segment.width;
+    }
+    return x == packer.width;
+}
+
+// Every rect inside the page and no two rects sharing a texel
+static bool placement_valid(const SkylinePacker &packer, const std::vector<Rect> &rects) {
+    for (size_t i = 0; i < rects.size(); i++) {
+        const Rect &a = rects[i];
+        if (a.x + a.width > packer.width || a.y + a.height > packer.height) {
+            return false;
+        }
+        for (size_t j = i + 1; j < rects.size(); j++) {
+            const Rect &b = rects[j];
+            if (a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height &&
+                b.y < a.y + a.height) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+module::module(flecs::world &world) {
+    std::mt19937 rng{42};
+    // Mostly small sprites with the odd large one, sizes include the atlas padding
+    std::uniform_int_distribution<uint32_t> small(4, 66);
+    std::uniform_int_distribution<uint32_t> large(66, 514);
+    std::uniform_int_distribution<uint32_t> pick(0, 9);
+
+    SkylinePacker packer;
+    std::vector<Rect> rects;
+    double fill = 0.0;
+    double seconds = 0.0;
+    size_t inserted = 0;
+    int failed = 0;
+    for (int page = 0; page < pages; page++) {
+        packer.reset(page_size, page_size);
+        rects.clear();
+        auto start = std::chrono::steady_clock::now();
+        while (true) {
+            uint32_t width = pick(rng) == 0 ? large(rng) : small(rng);
+            uint32_t height = pick(rng) == 0 ? large(rng) : small(rng);
+            Rect rect{0, 0, width, height};
+            if (!packer.insert(width, height, rect.x, rect.y)) {
+                break;
+            }
+            rects.push_back(rect);
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (!skyline_valid(packer) || !placement_valid(packer, rects)) {
+            failed++;
+        }
+        fill += (double)packer.used_area / ((double)page_size * page_size);
+        inserted += rects.size();
+    }
+
+    std::printf("Atlas benchmark, %d pages of %u\n", pages, page_size);
+    std::printf("  %zu rects, %.1f per page, %.1f%% filled, %.3f us per insert\n", inserted,
+                (double)inserted / pages, 100.0 * fill / pages, seconds * 1e6 / inserted);
+    if (failed > 0) {
+        std::printf("  %d pages with overlapping rects or an invalid skyline\n", failed);
+        bench::exit_code = 1;
+    }
+
+    world.quit();
+}
+
+} // namespace atlas_bench
@@ -0,0 +1,32 @@
+#include "bench.hpp"
+#include <iostream>
+#include <string_view>
+
+namespace bench {
+
+int exit_code = 0;
+
+bool init(flecs::world &world, int argc, char *argv[]) {
+    bool running = false;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--bench-aa") {
+            world.import <aa_bench::module>();
+            running = true;
+        } else if (arg == "--bench-packing") {
+            world.import <packing_bench::module>();
+            running = true;
+        } else if (arg == "--bench-allocations") {
+            world.import <allocation_bench::module>();
+            running = true;
+        } else if (arg == "--bench-atlas") {
+            world.import <atlas_bench::module>();
+            running = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+        }
+    }
+    return running;
+}
+
+} // namespace bench
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "flecs.h"
+
+namespace bench {
+
+// Import the benchmarks requested on the command line. Returns true if any benchmark is running,
+// in which case the frame rate should not be limited.
+bool init(flecs::world &world, int argc, char *argv[]);
+
+// Process exit code, set by benchmarks that check a requirement
+extern int exit_code;
+
+} // namespace bench
+
+// --bench-aa: frame time of every anti-aliasing mode over a dense scene
+namespace aa_bench {
+struct module {
+    module(flecs::world &world);
+};
+} // namespace aa_bench
+
+// --bench-packing: scalar and SIMD quad instance packing over synthetic table columns
+namespace packing_bench {
+struct module {
+    module(flecs::world &world);
+};
+} // namespace packing_bench
+
+// --bench-allocations: heap allocations per frame once the scene reached a steady state, fails if
+// any are made. Heap allocations are only counted when built with COUNT_ALLOCATIONS.
+namespace allocation_bench {
+struct module {
+    module(flecs::world &world);
+};
+} // namespace allocation_bench
+
+// --bench-atlas: fills atlas pages with random rects, fails if any overlap or the skyline is left
+// with gaps or unmerged segments
+namespace atlas_bench {
+struct module {
+    module(flecs::world &world);
+};
+} // namespace atlas_bench
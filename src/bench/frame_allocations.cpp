@@ -0,0 +1,52 @@
+#include "allocations.hpp"
+#include "bench.hpp"
+#include <cstdio>
+
+namespace allocation_bench {
+
+int warmup_frames = 120;
+int measured_frames = 600;
+
+struct State {
+    int frame = 0;
+    uint64_t heap_start = 0;
+    int64_t flecs_start = 0;
+};
+
+static int64_t flecs_allocations() {
+    return ecs_os_api_malloc_count + ecs_os_api_calloc_count + ecs_os_api_realloc_count;
+}
+
+module::module(flecs::world &world) {
+    if (!allocations::enabled()) {
+        std::printf("Allocation counting is disabled, configure with -DCOUNT_ALLOCATIONS=ON\n");
+    }
+    world.set<State>({});
+
+    world.system<State>().kind(flecs::OnLoad).each([](flecs::entity e, State &state) {
+        if (++state.frame == warmup_frames) {
+            state.heap_start = allocations::count();
+            state.flecs_start = flecs_allocations();
+            return;
+        }
+        if (state.frame < warmup_frames + measured_frames) {
+            return;
+        }
+
+        uint64_t heap = allocations::count() - state.heap_start;
+        int64_t flecs = flecs_allocations() - state.flecs_start;
+        std::printf("Steady state allocations over %d frames\n", measured_frames);
+        std::printf("  %-8s %10llu %10.2f per frame\n", "heap", (unsigned long long)heap,
+                    (double)heap / measured_frames);
+        std::printf("  %-8s %10lld %10.2f per frame\n", "flecs", (long long)flecs,
+                    (double)flecs / measured_frames);
+
+        if (allocations::enabled() && heap > 0) {
+            std::printf("FAILED: the frame loop allocates on the heap\n");
+            bench::exit_code = 1;
+        }
+        e.world().quit();
+    });
+}
+
+} // namespace allocation_bench
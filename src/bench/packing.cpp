@@ -0,0 +1,87 @@
+#include "bench.hpp"
+#include "../rendering/pipelines/packing.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace quad_pipeline;
+
+namespace packing_bench {
+
+int iterations = 2000;
+
+struct Columns {
+    std::vector<Position> positions;
+    std::vector<Quad> quads;
+    std::vector<Circle> circles;
+    std::vector<Color> colors;
+    std::vector<flecs::entity_t> entities;
+};
+
+Columns make_columns(size_t count) {
+    std::mt19937 rng{42};
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    Columns columns;
+    for (size_t i = 0; i < count; i++) {
+        columns.positions.push_back({unit(rng) * 640.0f, unit(rng) * 480.0f, unit(rng) * 6.28f});
+        columns.quads.push_back({unit(rng) * 20.0f, unit(rng) * 20.0f, unit(rng) * 5.0f});
+        columns.circles.push_back({unit(rng) * 10.0f});
+        columns.colors.push_back({unit(rng), unit(rng), unit(rng), 1.0f});
+        columns.entities.push_back(1000 + i);
+    }
+    return columns;
+}
+
+// Average nanoseconds per shape over all iterations
+template <typename Shape, typename Pack>
+double measure(const ShapeColumns<Shape> &columns, std::vector<BufferData> &out, Pack pack) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        pack(columns, out.data());
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations / columns.count;
+}
+
+template <typename Shape> void compare(const char *name, const ShapeColumns<Shape> &columns) {
+    std::vector<BufferData> scalar(columns.count);
+    std::vector<BufferData> vector(columns.count);
+
+    // Warm up caches and check both paths agree before timing
+    pack_scalar(columns, scalar.data());
+    pack_simd(columns, vector.data());
+    bool equal = std::memcmp(scalar.data(), vector.data(), columns.count * sizeof(BufferData)) == 0;
+
+    double scalar_ns = measure(columns, scalar, pack_scalar<Shape>);
+    double simd_ns = measure(columns, vector, pack_simd<Shape>);
+    std::printf("  %-8s %7zu %10.3f ns %10.3f ns %8.2fx%s\n", name, columns.count, scalar_ns,
+                simd_ns, scalar_ns / simd_ns, equal ? "" : "  MISMATCH");
+}
+
+module::module(flecs::world &world) {
+#if defined(SIMD_SSE)
+    const char *backend = "SSE2";
+#elif defined(SIMD_NEON)
+    const char *backend = "NEON";
+#else
+    const char *backend = "scalar fallback";
+#endif
+    std::printf("Packing benchmark (%s), %d iterations\n", backend, iterations);
+    std::printf("  %-8s %7s %13s %13s %9s\n", "shape", "count", "scalar", "simd", "speedup");
+
+    // Table sized to stay in cache and a large one bound by memory bandwidth
+    for (size_t count : {4096, 100000}) {
+        Columns data = make_columns(count);
+        compare<Quad>("quad", {data.quads.data(), data.positions.data(), data.colors.data(),
+                               nullptr, data.entities.data(), count});
+        compare<Circle>("circle", {data.circles.data(), data.positions.data(), data.colors.data(),
+                                   nullptr, data.entities.data(), count});
+    }
+
+    world.quit();
+}
+
+} // namespace packing_bench
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <vector>
 #include "webgpu/webgpu.hpp"
 #include <GLFW/glfw3.h>
 
@@ -24,6 +26,54 @@ struct Circle {
     float radius;
 };
 
+// Surface of a fixture
+struct Material {
+    float density = 1.0f;
+    float friction = 0.2f;
+    float restitution = 0.0f;
+};
+
+// Part of a compound shape, placed relative to the entity Position and rotated with it
+struct ShapePart {
+    enum class Kind : uint8_t { Box, Circle, Polygon, Chain };
+
+    Kind kind = Kind::Box;
+    float x = 0.0f;
+    float y = 0.0f;
+    float rotation = 0.0f;
+    // Boxes
+    float width = 0.0f;
+    float height = 0.0f;
+    float corner_radius = 0.0f;
+    // Circles
+    float radius = 0.0f;
+    // Convex polygons of up to 8 points, and chains of line segments
+    std::vector<std::array<float, 2>> points;
+    bool loop = false;
+    // Points an open chain continues into past its ends, so bodies slide over where it joins
+    // another chain. Without them the end segments are extended straight.
+    bool ghosts = false;
+    std::array<float, 2> ghost_start = {};
+    std::array<float, 2> ghost_end = {};
+
+    Material material;
+    uint16_t category = 0x0001;
+    uint16_t mask = 0xFFFF;
+    std::array<float, 4> color = {1.0f, 1.0f, 1.0f, 1.0f};
+};
+
+// Several fixtures on a single body. Boxes and circles are drawn by the quad pipeline, polygons
+// and chains only collide.
+struct Shapes {
+    std::vector<ShapePart> parts;
+};
+
+// Draw order of a shape, higher layers are drawn over lower ones. Layers within [-512, 512] map to
+// distinct depths, shapes without a layer are on layer 0.
+struct Layer {
+    float value;
+};
+
 struct Window {
     GLFWwindow *ptr;
     int width;
@@ -40,3 +90,18 @@ struct Window {
 };
 
 struct Input {};
+
+// World position shown at the center of the window
+struct Camera {
+    float x = 0.0f;
+    float y = 0.0f;
+};
+
+// Cursor position in framebuffer pixels (origin top left) and in world units (camera at the
+// center of the window, y up)
+struct Cursor {
+    int pixel_x;
+    int pixel_y;
+    float x;
+    float y;
+};
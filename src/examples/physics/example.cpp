@@ -1,21 +1,104 @@
 #include "example.hpp"
 #include "../../include.hpp"
 
+#include <cmath>
 #include <iostream>
+#include <vector>
 
 namespace physics_example {
 
 int x_amount = 5;
 int y_amount = 10;
 
+const char *snapshot_path = "physics.snapshot";
+
+// Thrown circles disappear after this many seconds
+float circle_lifetime = 30.0f;
+
+// Distance the arrow keys move the camera
+float camera_step = 128.0f;
+
+float explosion_radius = 60.0f;
+float explosion_impulse = 20000.0f;
+
+// Impacts harder than this throw sparks, at most this many per physics step
+float spark_impulse = 2000.0f;
+uint32_t max_sparks_per_step = 32;
+
 struct Holding {};
 
 float get_color(int value, int amount) { return ((float)value / (float)amount + 1.0f) / 2.0f; }
 
+// Fire and forget burst of glowing particles, simulated entirely on the GPU
+void emit_sparks(flecs::world &world, b2Vec2 point, uint32_t count, float speed) {
+    rendering::ParticleEmitter sparks;
+    sparks.burst = count;
+    sparks.one_shot = true;
+    sparks.speed = speed;
+    sparks.speed_variance = speed * 0.6f;
+    sparks.lifetime = 0.6f;
+    sparks.lifetime_variance = 0.3f;
+    sparks.size_start = 4.0f;
+    sparks.size_end = 1.0f;
+    sparks.color_start = {1.0f, 0.9f, 0.4f, 1.0f};
+    sparks.color_end = {0.9f, 0.2f, 0.0f, 0.0f};
+    sparks.gravity = -300.0f;
+    sparks.drag = 1.5f;
+    world.entity()
+        .set<Position>({point.x, point.y, 0.0f})
+        .set<Layer>({2.0f})
+        .set<rendering::ParticleEmitter>(sparks);
+}
+
+// Push every dynamic body near the point away from it
+void explode(flecs::world &world, b2Vec2 center) {
+    emit_sparks(world, center, 2000, 400.0f);
+
+    b2AABB area;
+    area.lowerBound = center - b2Vec2{explosion_radius, explosion_radius};
+    area.upperBound = center + b2Vec2{explosion_radius, explosion_radius};
+
+    std::vector<flecs::entity_t> hits;
+    physics::query_aabb(world, area, hits);
+    for (auto id : hits) {
+        flecs::entity hit{world, id};
+        if (!hit.has<DynamicBody>()) {
+            continue;
+        }
+        auto &pos = hit.get<Position>();
+        b2Vec2 offset{pos.x - center.x, pos.y - center.y};
+        float distance = offset.Normalize();
+        if (distance < explosion_radius) {
+            float strength = explosion_impulse * (1.0f - distance / explosion_radius);
+            physics::apply_impulse(world, id, strength * offset);
+        }
+    }
+}
+
 module::module(flecs::world &world) {
     world.import <rendering::module>();
     world.import <physics::module>();
     world.import <input::module>();
+    world.import <snapshot::module>();
+    world.import <lifetime::module>();
+    world.import <terrain::module>();
+    world.import <streaming::module>();
+
+    // Shapes that fall off the ground are deleted once they are well out of view
+    world.set<lifetime::WorldBounds>({-2000.0f, -1000.0f, 2000.0f, 4000.0f});
+
+    world.set<Camera>({});
+
+    // Rolling hills below the ground, built around the camera as it moves
+    terrain::TileMap hills{240, 32, 16.0f, -1920.0f, -720.0f, {}};
+    hills.tiles.resize(hills.width * hills.height);
+    for (int32_t x = 0; x < hills.width; x++) {
+        float height = 8.0f + 4.0f * std::sin(x * 0.15f) + 3.0f * std::sin(x * 0.04f);
+        for (int32_t y = 0; y < (int32_t)height; y++) {
+            hills.tiles[y * hills.width + x] = 1;
+        }
+    }
+    world.entity("Hills").set<terrain::TileMap>(std::move(hills));
 
     world.entity()
         .set<Quad>({200.0f, 10.0f})
@@ -23,35 +106,116 @@ module::module(flecs::world &world) {
         .set<Position>({0.0f, -200.0f, 0.0f})
         .add<StaticBody>();
 
+    std::vector<Position> positions;
+    std::vector<Quad> quads;
+    std::vector<Color> colors;
+    std::vector<DynamicBody> bodies;
     for (auto x = -x_amount; x <= x_amount; x++) {
         for (auto y = -y_amount; y <= y_amount; y++) {
-            world.entity()
-                .set<Quad>({
-                    8.0f,
-                    8.0f,
-                })
-                .set<Color>({0.5f, get_color(x, x_amount), get_color(y, y_amount), 1.0f})
-                .set<Position>({x * 16.0f, y * 16.0f, 0.0f})
-                .set<DynamicBody>({1.0f, 0.3f});
+            positions.push_back({x * 16.0f, y * 16.0f, 0.0f});
+            quads.push_back({8.0f, 8.0f});
+            colors.push_back({0.5f, get_color(x, x_amount), get_color(y, y_amount), 1.0f});
+            bodies.push_back({1.0f, 0.3f});
         }
     }
 
+    spawn::ShapeDesc grid;
+    grid.count = (int32_t)positions.size();
+    grid.positions = positions.data();
+    grid.quads = quads.data();
+    grid.colors = colors.data();
+    grid.dynamic_bodies = bodies.data();
+    spawn::shapes(world, grid);
+
+    // Dumbbell above the grid, one body with a bar and two heavier, bouncier weights
+    ShapePart bar;
+    bar.width = 40.0f;
+    bar.height = 4.0f;
+    bar.color = {0.3f, 0.3f, 0.3f, 1.0f};
+    ShapePart weight;
+    weight.kind = ShapePart::Kind::Circle;
+    weight.radius = 8.0f;
+    weight.material = {4.0f, 0.3f, 0.5f};
+    weight.color = {0.2f, 0.4f, 0.8f, 1.0f};
+    Shapes dumbbell{{bar, weight, weight}};
+    dumbbell.parts[1].x = -20.0f;
+    dumbbell.parts[2].x = 20.0f;
+    world.entity()
+        .set<Position>({0.0f, (y_amount + 4) * 16.0f, 0.3f})
+        .set<Shapes>(dumbbell)
+        .set<DynamicBody>({1.0f, 0.3f});
+
+    // Textured crates drawn by the sprite pipeline from the atlas. Snapshots have no column for the
+    // texture, so the crates stay out of them and out of streaming.
+    auto crate = world.entity("Crate").set<rendering::Image>({ASSET_DIR "/images/crate.png"});
+    for (int i = 0; i < 3; i++) {
+        world.entity()
+            .set<Quad>({12.0f, 12.0f})
+            .set<Position>({(x_amount + 4) * 16.0f + i * 8.0f, i * 26.0f - 150.0f, 0.0f})
+            .set<DynamicBody>({1.0f, 0.3f})
+            .add<rendering::RenderTexture>(crate)
+            .add<snapshot::Exclude>();
+    }
+
+    // Only hard impacts are recorded, they throw sparks
+    physics::ContactFilter impacts;
+    impacts.begin = false;
+    impacts.end = false;
+    impacts.impacts = true;
+    impacts.min_impulse = spark_impulse;
+    world.set<physics::ContactFilter>(impacts);
+    world.entity<physics::Contacts>().observe<physics::ContactBatch>(
+        [](flecs::entity e, physics::ContactBatch &) {
+            flecs::world world = e.world();
+            uint32_t emitted = 0;
+            for (auto &event : world.get<physics::Contacts>().events) {
+                if (event.kind != physics::ContactEvent::Impact) {
+                    continue;
+                }
+                emit_sparks(world, event.point, 40, 150.0f);
+                if (++emitted == max_sparks_per_step) {
+                    break;
+                }
+            }
+        });
+
     world.entity<Input>()
         .observe<MousePress>([](flecs::entity e, MousePress &event) {
             flecs::world world = e.world();
-            if (world.has<Holding>()) {
+            if (event.button == GLFW_MOUSE_BUTTON_RIGHT) {
+                explode(world, {event.x, event.y});
+                return;
+            }
+            if (event.button != GLFW_MOUSE_BUTTON_LEFT || world.has<Holding>()) {
                 return;
             }
 
+            // Drag the shape under the cursor, otherwise start holding a new circle
+            flecs::entity_t hovered_id = world.get<rendering::Hovered>().entity;
+            flecs::entity hovered{world, hovered_id};
+            if (hovered_id != 0 && hovered.is_alive() && hovered.has<DynamicBody>()) {
+                physics::begin_drag(world, hovered, {event.x, event.y});
+                return;
+            }
+
+            // Translucent and above the pile until released
             auto circle = world.entity()
                               .set<Circle>({10.0f})
-                              .set<Color>({0.8f, 0.3f, 0.3f, 1.0f})
+                              .set<Color>({0.8f, 0.3f, 0.3f, 0.6f})
+                              .set<Layer>({1.0f})
                               .set<Position>({event.x, event.y, 0.0f});
 
             world.add<Holding>(circle);
         })
         .observe<MouseRelease>([](flecs::entity e, MouseRelease &event) {
             flecs::world world = e.world();
+            if (event.button != GLFW_MOUSE_BUTTON_LEFT) {
+                return;
+            }
+            if (world.get<physics::Drag>().joint != nullptr) {
+                physics::end_drag(world);
+                return;
+            }
             if (!world.has<Holding>(flecs::Wildcard)) {
                 return;
             }
@@ -59,9 +223,63 @@ module::module(flecs::world &world) {
             auto circle = world.target<Holding>();
             auto pos = circle.get<Position>();
 
-            circle.set<DynamicBody>({1.0f, 0.3f}).set<Impulse>({pos.x - event.x, pos.y - event.y});
+            circle.set<Color>({0.8f, 0.3f, 0.3f, 1.0f});
+            circle.remove<Layer>();
+            circle.set<DynamicBody>({1.0f, 0.3f});
+            circle.set<lifetime::Lifetime>({circle_lifetime});
+            physics::apply_impulse(world, circle,
+                                   {(pos.x - event.x) * 300.0f, (pos.y - event.y) * 300.0f});
 
             world.remove<Holding>(circle);
+        })
+        .observe<MouseMove>([](flecs::entity e, MouseMove &event) {
+            flecs::world world = e.world();
+            physics::update_drag(world, {event.x, event.y});
+        })
+        .observe<KeyPress>([](flecs::entity e, KeyPress &event) {
+            flecs::world world = e.world();
+            if (event.key == GLFW_KEY_F2) {
+                auto settings = world.get<rendering::Settings>();
+                settings.anti_aliasing = (rendering::AntiAliasing)(
+                    ((int)settings.anti_aliasing + 1) % 3);
+                world.set<rendering::Settings>(settings);
+            }
+            // F6 toggles the glow around sparks and other bright shapes
+            if (event.key == GLFW_KEY_F6) {
+                auto settings = world.get<rendering::Settings>();
+                settings.bloom = settings.bloom > 0.0f ? 0.0f : 1.0f;
+                world.set<rendering::Settings>(settings);
+            }
+            // Physics debug lines: F3 toggles outlines, joints and contacts, F4 bounding boxes
+            if (event.key == GLFW_KEY_F3) {
+                auto draw = world.get<physics::DebugDraw>();
+                draw.shapes = draw.joints = draw.contacts = !draw.shapes;
+                world.set<physics::DebugDraw>(draw);
+            }
+            if (event.key == GLFW_KEY_F4) {
+                auto draw = world.get<physics::DebugDraw>();
+                draw.aabbs = !draw.aabbs;
+                world.set<physics::DebugDraw>(draw);
+            }
+            auto &camera = world.get_mut<Camera>();
+            if (event.key == GLFW_KEY_LEFT) {
+                camera.x -= camera_step;
+            }
+            if (event.key == GLFW_KEY_RIGHT) {
+                camera.x += camera_step;
+            }
+            if (event.key == GLFW_KEY_DOWN) {
+                camera.y -= camera_step;
+            }
+            if (event.key == GLFW_KEY_UP) {
+                camera.y += camera_step;
+            }
+            if (event.key == GLFW_KEY_F5) {
+                world.set<snapshot::Save>({snapshot_path});
+            }
+            if (event.key == GLFW_KEY_F9) {
+                world.set<snapshot::Load>({snapshot_path});
+            }
         });
 }
 } // namespace physics_example
\ No newline at end of file
@@ -2,5 +2,19 @@
 
 #include "common.hpp"
 #include "input/input.hpp"
+#include "lifetime/lifetime.hpp"
 #include "physics/physics.hpp"
+#include "physics/query.hpp"
+#include "rendering/arena.hpp"
+#include "rendering/atlas.hpp"
+#include "rendering/commands.hpp"
+#include "rendering/graph.hpp"
+#include "rendering/lines.hpp"
+#include "rendering/memory.hpp"
+#include "rendering/mirror.hpp"
+#include "rendering/particles.hpp"
 #include "rendering/rendering.hpp"
+#include "snapshot/snapshot.hpp"
+#include "spawn/spawn.hpp"
+#include "streaming/streaming.hpp"
+#include "terrain/terrain.hpp"
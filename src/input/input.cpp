@@ -5,27 +5,50 @@
 
 namespace input {
 
-void mouse_button_callback(GLFWwindow *ptr, int /*button*/, int action, int /*mods*/) {
+// Convert a cursor position to world units, the camera at the center of the window and y up
+Cursor to_cursor(flecs::world &world, double x, double y) {
+    auto &window = world.ensure<Window>();
+    const Camera *camera = world.try_get<Camera>();
+    float world_x = (float)(x - window.width / 2.0) + (camera != nullptr ? camera->x : 0.0f);
+    float world_y = (float)-(y - window.height / 2.0) + (camera != nullptr ? camera->y : 0.0f);
+    return {(int)x, (int)y, world_x, world_y};
+}
+
+void mouse_button_callback(GLFWwindow *ptr, int button, int action, int /*mods*/) {
     flecs::world world{(flecs::world_t *)glfwGetWindowUserPointer(ptr)};
     auto input = world.entity<Input>();
     double x, y;
     glfwGetCursorPos(ptr, &x, &y);
-
-    auto &window = world.ensure<Window>();
-    x -= window.width / 2.0;
-    y -= window.height / 2.0;
+    Cursor cursor = to_cursor(world, x, y);
 
     if (action == GLFW_PRESS) {
-        input.emit<MousePress>({(float)x, -(float)y});
+        input.emit<MousePress>({cursor.x, cursor.y, button});
     }
     if (action == GLFW_RELEASE) {
-        input.emit<MouseRelease>({(float)x, -(float)y});
+        input.emit<MouseRelease>({cursor.x, cursor.y, button});
+    }
+}
+
+void cursor_position_callback(GLFWwindow *ptr, double x, double y) {
+    flecs::world world{(flecs::world_t *)glfwGetWindowUserPointer(ptr)};
+    Cursor cursor = to_cursor(world, x, y);
+    world.get_mut<Cursor>() = cursor;
+    world.entity<Input>().emit<MouseMove>({cursor.x, cursor.y});
+}
+
+void key_callback(GLFWwindow *ptr, int key, int /*scancode*/, int action, int mods) {
+    flecs::world world{(flecs::world_t *)glfwGetWindowUserPointer(ptr)};
+    if (action == GLFW_PRESS) {
+        world.entity<Input>().emit<KeyPress>({key, mods});
     }
 }
 
 module::module(flecs::world &world) {
     auto &window = world.ensure<Window>();
     world.add<Input>();
+    world.set<Cursor>({-1, -1, 0.0f, 0.0f});
     glfwSetMouseButtonCallback(window.ptr, mouse_button_callback);
+    glfwSetCursorPosCallback(window.ptr, cursor_position_callback);
+    glfwSetKeyCallback(window.ptr, key_callback);
 }
-} // namespace input
\ No newline at end of file
+} // namespace input
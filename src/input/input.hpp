@@ -5,11 +5,23 @@
 struct MousePress {
     float x;
     float y;
+    int button;
 };
 
 struct MouseRelease {
     float x;
     float y;
+    int button;
+};
+
+struct MouseMove {
+    float x;
+    float y;
+};
+
+struct KeyPress {
+    int key;
+    int mods;
 };
 
 namespace input {
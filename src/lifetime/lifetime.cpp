@@ -0,0 +1,48 @@
+#include "lifetime.hpp"
+#include "../include.hpp"
+
+namespace lifetime {
+
+module::module(flecs::world &world) {
+    world.component<Lifetime>().member<float>("remaining");
+    world.component<Persistent>();
+    world.component<WorldBounds>()
+        .member<float>("min_x")
+        .member<float>("min_y")
+        .member<float>("max_x")
+        .member<float>("max_y");
+    world.component<Despawned>().member<uint64_t>("expired").member<uint64_t>("out_of_bounds");
+    world.set<Despawned>({0, 0});
+
+    world.system<Lifetime, Despawned>("lifetime::Expire")
+        .term_at(1)
+        .singleton()
+        .kind(flecs::PostUpdate)
+        .each([](flecs::iter &it, size_t row, Lifetime &lifetime, Despawned &despawned) {
+            lifetime.remaining -= it.delta_time();
+            if (lifetime.remaining <= 0.0f) {
+                it.entity(row).destruct();
+                despawned.expired++;
+            }
+        });
+
+    // Sleeping bodies don't move, so they can't have left the bounds since the last check
+    world.system<const Position, const WorldBounds, Despawned>("lifetime::KillPlane")
+        .term_at(1)
+        .singleton()
+        .term_at(2)
+        .singleton()
+        .with<physics::BodyPtr>()
+        .without<Persistent>()
+        .without<Sleeping>()
+        .kind(flecs::PostUpdate)
+        .each([](flecs::entity e, const Position &pos, const WorldBounds &bounds,
+                 Despawned &despawned) {
+            if (!bounds.contains(pos.x, pos.y)) {
+                e.destruct();
+                despawned.out_of_bounds++;
+            }
+        });
+}
+
+} // namespace lifetime
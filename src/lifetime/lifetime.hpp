@@ -0,0 +1,42 @@
+#pragma once
+
+#include "flecs.h"
+#include <cstdint>
+
+namespace lifetime {
+
+// Seconds until the entity is deleted
+struct Lifetime {
+    float remaining;
+};
+
+// Tag for bodies that are never deleted for leaving the WorldBounds, like terrain chunks
+struct Persistent {};
+
+// Singleton AABB in world units, physics bodies whose Position is outside of it are deleted.
+// Entities without a body and Persistent entities are kept.
+struct WorldBounds {
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+
+    bool contains(float x, float y) const {
+        return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+    }
+};
+
+// Entities removed since the module was imported, for the inspector
+struct Despawned {
+    uint64_t expired;
+    uint64_t out_of_bounds;
+};
+
+// Expired and out of bounds entities are deleted in PostUpdate. Deletes are deferred and merged at
+// the PostUpdate sync point, where the BodyPtr hook releases their bodies, and the render
+// pipelines drop them from their instance buffers on the next repack.
+struct module {
+    module(flecs::world &world);
+};
+
+} // namespace lifetime
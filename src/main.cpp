@@ -1,14 +1,16 @@
 #include "examples/physics/example.hpp"
 #include "flecs.h"
+#include "bench/bench.hpp"
 #include <iostream>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif // __EMSCRIPTEN__
 
-int main(void) {
+int main(int argc, char *argv[]) {
     flecs::world world{ecs_init()};
     world.import <physics_example::module>();
+    [[maybe_unused]] bool benchmark = bench::init(world, argc, argv);
 
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop_arg(
@@ -22,7 +24,10 @@ int main(void) {
 #else  // __EMSCRIPTEN__
     flecs::app_builder app{world};
     app.enable_rest();
-    app.target_fps(60.0);
-    return app.run();
+    if (!benchmark) {
+        app.target_fps(60.0);
+    }
+    int result = app.run();
+    return result != 0 ? result : bench::exit_code;
 #endif // __EMSCRIPTEN__
 }
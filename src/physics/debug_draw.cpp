@@ -0,0 +1,114 @@
+#include "../include.hpp"
+#include <box2d/box2d.h>
+#include <cmath>
+
+namespace physics {
+
+constexpr int circle_segments = 16;
+constexpr float line_width = 1.0f;
+constexpr float axis_length = 8.0f;
+
+// Box2D debug callbacks turned into line segments, solid shapes are drawn as outlines
+struct LineRenderer : b2Draw {
+    rendering::DebugLines &out;
+
+    LineRenderer(rendering::DebugLines &out) : out(out) {}
+
+    static std::array<float, 4> to_color(const b2Color &color) {
+        return {color.r, color.g, color.b, color.a};
+    }
+
+    void DrawPolygon(const b2Vec2 *vertices, int32 count, const b2Color &color) override {
+        auto c = to_color(color);
+        for (int32 i = 0; i < count; i++) {
+            const b2Vec2 &a = vertices[i];
+            const b2Vec2 &b = vertices[(i + 1) % count];
+            out.line(a.x, a.y, b.x, b.y, c, line_width);
+        }
+    }
+
+    void DrawSolidPolygon(const b2Vec2 *vertices, int32 count, const b2Color &color) override {
+        DrawPolygon(vertices, count, color);
+    }
+
+    void DrawCircle(const b2Vec2 &center, float radius, const b2Color &color) override {
+        auto c = to_color(color);
+        b2Vec2 previous = center + b2Vec2(radius, 0.0f);
+        for (int i = 1; i <= circle_segments; i++) {
+            float angle = 2.0f * b2_pi * (float)i / (float)circle_segments;
+            b2Vec2 next = center + radius * b2Vec2(std::cos(angle), std::sin(angle));
+            out.line(previous.x, previous.y, next.x, next.y, c, line_width);
+            previous = next;
+        }
+    }
+
+    void DrawSolidCircle(const b2Vec2 &center, float radius, const b2Vec2 &axis,
+                         const b2Color &color) override {
+        DrawCircle(center, radius, color);
+        b2Vec2 end = center + radius * axis;
+        out.line(center.x, center.y, end.x, end.y, to_color(color), line_width);
+    }
+
+    void DrawSegment(const b2Vec2 &p1, const b2Vec2 &p2, const b2Color &color) override {
+        out.line(p1.x, p1.y, p2.x, p2.y, to_color(color), line_width);
+    }
+
+    void DrawTransform(const b2Transform &xf) override {
+        b2Vec2 x_axis = xf.p + axis_length * xf.q.GetXAxis();
+        b2Vec2 y_axis = xf.p + axis_length * xf.q.GetYAxis();
+        out.line(xf.p.x, xf.p.y, x_axis.x, x_axis.y, {1.0f, 0.0f, 0.0f, 1.0f}, line_width);
+        out.line(xf.p.x, xf.p.y, y_axis.x, y_axis.y, {0.0f, 1.0f, 0.0f, 1.0f}, line_width);
+    }
+
+    void DrawPoint(const b2Vec2 &p, float size, const b2Color &color) override {
+        out.point(p.x, p.y, to_color(color), size);
+    }
+};
+
+// Box2D only draws contacts in its testbed, touching contacts are drawn as their manifold points
+// and normals
+static void draw_contacts(b2World *world, rendering::DebugLines &out) {
+    const std::array<float, 4> point_color{1.0f, 0.9f, 0.2f, 1.0f};
+    const std::array<float, 4> normal_color{0.2f, 0.9f, 1.0f, 1.0f};
+
+    for (b2Contact *contact = world->GetContactList(); contact != nullptr;
+         contact = contact->GetNext()) {
+        if (!contact->IsTouching()) {
+            continue;
+        }
+        b2WorldManifold manifold;
+        contact->GetWorldManifold(&manifold);
+        for (int32 i = 0; i < contact->GetManifold()->pointCount; i++) {
+            b2Vec2 p = manifold.points[i];
+            b2Vec2 end = p + axis_length * manifold.normal;
+            out.point(p.x, p.y, point_color, 4.0f);
+            out.line(p.x, p.y, end.x, end.y, normal_color, line_width);
+        }
+    }
+}
+
+void capture_debug_draw(flecs::world &world, const PhysicsWorld &p_world, const DebugDraw &draw) {
+    auto *lines = world.try_get_mut<rendering::DebugLines>();
+    if (lines == nullptr) {
+        return;
+    }
+
+    uint32 flags = 0;
+    flags |= draw.shapes ? (uint32)b2Draw::e_shapeBit : 0u;
+    flags |= draw.joints ? (uint32)b2Draw::e_jointBit : 0u;
+    flags |= draw.aabbs ? (uint32)b2Draw::e_aabbBit : 0u;
+    flags |= draw.centers_of_mass ? (uint32)b2Draw::e_centerOfMassBit : 0u;
+
+    if (flags != 0) {
+        LineRenderer renderer(*lines);
+        renderer.SetFlags(flags);
+        p_world.ptr->SetDebugDraw(&renderer);
+        p_world.ptr->DebugDraw();
+        p_world.ptr->SetDebugDraw(nullptr);
+    }
+    if (draw.contacts) {
+        draw_contacts(p_world.ptr, *lines);
+    }
+}
+
+} // namespace physics
@@ -1,36 +1,527 @@
 #include "../include.hpp"
+#include <algorithm>
 #include <box2d/box2d.h>
+#include <chrono>
+#include <iostream>
 
 namespace physics {
 
+b2Body *create_body(b2World *world, flecs::entity_t e, b2BodyType type, const Position &pos,
+                    const b2Shape &shape, float density, float friction) {
+    b2BodyDef body_def;
+    body_def.type = type;
+    body_def.position.Set(pos.x, pos.y);
+    body_def.angle = pos.rotation;
+    body_def.userData.pointer = (uintptr_t)e;
+    b2Body *body = world->CreateBody(&body_def);
+
+    b2FixtureDef fixture;
+    fixture.shape = &shape;
+    fixture.density = density;
+    fixture.friction = friction;
+    body->CreateFixture(&fixture);
+
+    return body;
+}
+
+// Pool key of a body, false for bodies that don't match what create_box or create_circle make
+static bool pool_key(b2Body *body, BodyKey &key) {
+    b2Fixture *fixture = body->GetFixtureList();
+    if (fixture == nullptr || fixture->GetNext() != nullptr) {
+        return false;
+    }
+
+    // Fixture properties create_box and create_circle leave at their defaults. A compound or a
+    // body whose filter was changed may only stand in for a plain body if it looks like one.
+    const b2Filter &filter = fixture->GetFilterData();
+    b2Filter default_filter;
+    if (fixture->GetRestitution() != 0.0f || fixture->IsSensor() ||
+        filter.categoryBits != default_filter.categoryBits ||
+        filter.maskBits != default_filter.maskBits ||
+        filter.groupIndex != default_filter.groupIndex) {
+        return false;
+    }
+
+    key.type = body->GetType();
+    key.shape = fixture->GetType();
+    key.density = fixture->GetDensity();
+    key.friction = fixture->GetFriction();
+
+    if (key.shape == b2Shape::e_circle) {
+        auto *circle = (b2CircleShape *)fixture->GetShape();
+        if (circle->m_p != b2Vec2_zero) {
+            return false;
+        }
+        key.width = key.height = circle->m_radius * 2.0f;
+        return true;
+    }
+
+    if (key.shape == b2Shape::e_polygon) {
+        auto *polygon = (b2PolygonShape *)fixture->GetShape();
+        const b2Vec2 *v = polygon->m_vertices;
+        // SetAsBox without offset or angle
+        if (polygon->m_count != 4 || v[0] != -v[2] || v[1] != b2Vec2(v[2].x, v[0].y)) {
+            return false;
+        }
+        key.width = v[2].x * 2.0f;
+        key.height = v[2].y * 2.0f;
+        return true;
+    }
+
+    return false;
+}
+
+static b2Body *reuse_body(PhysicsWorld &world, const BodyKey &key, flecs::entity_t e,
+                          const Position &pos) {
+    b2Body *body = world.pool.acquire(key);
+    if (body == nullptr) {
+        return nullptr;
+    }
+
+    // Moved while still disabled, so the broadphase proxies are created at the new position
+    body->SetTransform({pos.x, pos.y}, pos.rotation);
+    body->SetLinearVelocity(b2Vec2_zero);
+    body->SetAngularVelocity(0.0f);
+    body->GetUserData().pointer = (uintptr_t)e;
+    body->GetFixtureList()->SetFilterData(b2Filter());
+    body->SetEnabled(true);
+    body->SetAwake(true);
+    return body;
+}
+
+b2Body *create_box(PhysicsWorld &world, flecs::entity_t e, b2BodyType type, const Position &pos,
+                   const Quad &quad, float density, float friction) {
+    BodyKey key{type, b2Shape::e_polygon, quad.width, quad.height, density, friction};
+    if (b2Body *body = reuse_body(world, key, e, pos)) {
+        return body;
+    }
+
+    b2PolygonShape box;
+    box.SetAsBox(quad.width / 2.0f, quad.height / 2.0f);
+    return create_body(world.ptr, e, type, pos, box, density, friction);
+}
+
+b2Body *create_circle(PhysicsWorld &world, flecs::entity_t e, b2BodyType type,
+                      const Position &pos, const Circle &circle, float density, float friction) {
+    float diameter = circle.radius * 2.0f;
+    BodyKey key{type, b2Shape::e_circle, diameter, diameter, density, friction};
+    if (b2Body *body = reuse_body(world, key, e, pos)) {
+        return body;
+    }
+
+    b2CircleShape shape;
+    shape.m_radius = circle.radius;
+    return create_body(world.ptr, e, type, pos, shape, density, friction);
+}
+
+// b2PolygonShape::Set asserts on points that don't span a hull and falls back to a 1x1 box in
+// release builds. Points closer than half the linear slop are welded like Set does, and what is
+// left must enclose more area than Box2D's centroid computation accepts.
+static bool valid_hull(const std::vector<b2Vec2> &points) {
+    b2Vec2 unique[b2_maxPolygonVertices];
+    int32 count = 0;
+    for (const b2Vec2 &p : points) {
+        bool welded = false;
+        for (int32 i = 0; i < count && !welded; i++) {
+            welded = b2DistanceSquared(p, unique[i]) < 0.25f * b2_linearSlop * b2_linearSlop;
+        }
+        if (!welded) {
+            unique[count++] = p;
+        }
+    }
+    if (count < 3) {
+        return false;
+    }
+
+    // Monotone chain hull, then its area
+    std::sort(unique, unique + count, [](const b2Vec2 &a, const b2Vec2 &b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    b2Vec2 hull[2 * b2_maxPolygonVertices];
+    int32 size = 0;
+    auto turns_left = [&](const b2Vec2 &p) {
+        return b2Cross(hull[size - 1] - hull[size - 2], p - hull[size - 2]) > 0.0f;
+    };
+    for (int32 i = 0; i < count; i++) {
+        while (size >= 2 && !turns_left(unique[i])) {
+            size--;
+        }
+        hull[size++] = unique[i];
+    }
+    for (int32 i = count - 2, lower = size + 1; i >= 0; i--) {
+        while (size >= lower && !turns_left(unique[i])) {
+            size--;
+        }
+        hull[size++] = unique[i];
+    }
+    size--;
+    if (size < 3) {
+        return false;
+    }
+    float area = 0.0f;
+    for (int32 i = 0; i < size; i++) {
+        area += 0.5f * b2Cross(hull[i], hull[(i + 1) % size]);
+    }
+    return area > b2_epsilon;
+}
+
+// CreateChain and CreateLoop assert that neighbouring vertices are further apart than the linear
+// slop, for loops that includes the closing segment
+static bool valid_chain(const std::vector<b2Vec2> &points, bool loop) {
+    size_t count = points.size();
+    for (size_t i = loop ? 0 : 1; i < count; i++) {
+        const b2Vec2 &previous = points[(i + count - 1) % count];
+        if (b2DistanceSquared(previous, points[i]) <= b2_linearSlop * b2_linearSlop) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Shape of a compound part in body space, false if the part can't be a fixture
+static bool part_shape(const ShapePart &part, b2PolygonShape &polygon, b2CircleShape &circle,
+                       b2ChainShape &chain, const b2Shape *&shape) {
+    b2Transform xf({part.x, part.y}, b2Rot(part.rotation));
+    std::vector<b2Vec2> points(part.points.size());
+    for (size_t i = 0; i < part.points.size(); i++) {
+        points[i] = b2Mul(xf, b2Vec2(part.points[i][0], part.points[i][1]));
+    }
+    int32 count = (int32)points.size();
+
+    switch (part.kind) {
+    case ShapePart::Kind::Box:
+        polygon.SetAsBox(part.width / 2.0f, part.height / 2.0f, xf.p, part.rotation);
+        shape = &polygon;
+        return part.width > 0.0f && part.height > 0.0f;
+    case ShapePart::Kind::Circle:
+        circle.m_radius = part.radius;
+        circle.m_p = xf.p;
+        shape = &circle;
+        return part.radius > 0.0f;
+    case ShapePart::Kind::Polygon:
+        if (count < 3 || count > b2_maxPolygonVertices || !valid_hull(points)) {
+            return false;
+        }
+        polygon.Set(points.data(), count);
+        shape = &polygon;
+        return true;
+    case ShapePart::Kind::Chain:
+        if (count < 2 || (part.loop && count < 3) || !valid_chain(points, part.loop)) {
+            return false;
+        }
+        if (part.loop) {
+            chain.CreateLoop(points.data(), count);
+        } else {
+            // Ghost vertices continue the first and last segment unless the part has its own
+            b2Vec2 ghost_start = 2.0f * points[0] - points[1];
+            b2Vec2 ghost_end = 2.0f * points[count - 1] - points[count - 2];
+            if (part.ghosts) {
+                ghost_start = b2Mul(xf, b2Vec2(part.ghost_start[0], part.ghost_start[1]));
+                ghost_end = b2Mul(xf, b2Vec2(part.ghost_end[0], part.ghost_end[1]));
+            }
+            chain.CreateChain(points.data(), count, ghost_start, ghost_end);
+        }
+        shape = &chain;
+        return true;
+    }
+    return false;
+}
+
+b2Body *create_compound(PhysicsWorld &world, flecs::entity_t e, b2BodyType type,
+                        const Position &pos, const Shapes &shapes) {
+    b2BodyDef body_def;
+    body_def.type = type;
+    body_def.position.Set(pos.x, pos.y);
+    body_def.angle = pos.rotation;
+    body_def.userData.pointer = (uintptr_t)e;
+    b2Body *body = world.ptr->CreateBody(&body_def);
+
+    for (const ShapePart &part : shapes.parts) {
+        b2PolygonShape polygon;
+        b2CircleShape circle;
+        b2ChainShape chain;
+        const b2Shape *shape = nullptr;
+        if (!part_shape(part, polygon, circle, chain, shape)) {
+            std::cerr << "Skipping invalid compound shape part of entity " << e << std::endl;
+            continue;
+        }
+
+        b2FixtureDef fixture;
+        fixture.shape = shape;
+        fixture.density = part.material.density;
+        fixture.friction = part.material.friction;
+        fixture.restitution = part.material.restitution;
+        fixture.filter.categoryBits = part.category;
+        fixture.filter.maskBits = part.mask;
+        body->CreateFixture(&fixture);
+    }
+
+    return body;
+}
+
+void set_collision_filter(flecs::world &world, flecs::entity_t e, uint16_t category,
+                          uint16_t mask) {
+    const BodyPtr *body = flecs::entity(world, e).try_get<BodyPtr>();
+    if (body == nullptr) {
+        return;
+    }
+    b2Filter filter;
+    filter.categoryBits = category;
+    filter.maskBits = mask;
+    for (b2Fixture *f = body->ptr->GetFixtureList(); f != nullptr; f = f->GetNext()) {
+        f->SetFilterData(filter);
+    }
+}
+
+void release_body(flecs::world &world, PhysicsWorld &p_world, b2Body *body) {
+    // Joints would otherwise keep a pooled body attached to whatever it was connected to
+    Drag *drag = world.try_get_mut<Drag>();
+    b2JointEdge *edge = body->GetJointList();
+    while (edge != nullptr) {
+        b2Joint *joint = edge->joint;
+        edge = edge->next;
+        if (drag != nullptr && drag->joint == joint) {
+            *drag = {};
+        }
+        p_world.ptr->DestroyJoint(joint);
+    }
+
+    // Destroying or disabling the body ends its contacts, EndContact must not report the entity
+    body->GetUserData().pointer = 0;
+
+    BodyKey key;
+    if (!pool_key(body, key) || !p_world.pool.release(key, body)) {
+        p_world.ptr->DestroyBody(body);
+        return;
+    }
+
+    // Disabling removes the fixtures from the broadphase and destroys the body's contacts
+    body->SetEnabled(false);
+}
+
+void create_bodies(PhysicsWorld &world, int32_t count, const Position *positions,
+                   const Quad *quads, const Circle *circles, const DynamicBody *defs,
+                   const BodyState *states, BodyPtr *out) {
+    b2BodyType type = defs != nullptr ? b2_dynamicBody : b2_staticBody;
+    for (int32_t i = 0; i < count; i++) {
+        float density = defs != nullptr ? defs[i].density : 0.0f;
+        float friction = defs != nullptr ? defs[i].friction : 0.2f;
+
+        b2Body *body =
+            quads != nullptr
+                ? create_box(world, 0, type, positions[i], quads[i], density, friction)
+                : create_circle(world, 0, type, positions[i], circles[i], density, friction);
+
+        if (states != nullptr) {
+            body->SetLinearVelocity(states[i].linear_velocity);
+            body->SetAngularVelocity(states[i].angular_velocity);
+            body->SetAwake(states[i].awake != 0);
+        }
+        out[i].ptr = body;
+    }
+}
+
+static void push_command(flecs::world &world, BodyCommand command) {
+    auto &commands = world.get_mut<Commands>();
+    size_t stage = (size_t)world.get_stage_id();
+    ecs_assert(stage < commands.stages.size(), ECS_INVALID_OPERATION,
+               "stage count changed without draining physics commands");
+    commands.stages[stage].push_back(command);
+}
+
+void apply_impulse(flecs::world &world, flecs::entity_t e, b2Vec2 impulse) {
+    push_command(world, {BodyCommand::ApplyImpulse, e, impulse, 0.0f});
+}
+
+void apply_force(flecs::world &world, flecs::entity_t e, b2Vec2 force) {
+    push_command(world, {BodyCommand::ApplyForce, e, force, 0.0f});
+}
+
+void set_velocity(flecs::world &world, flecs::entity_t e, b2Vec2 velocity) {
+    push_command(world, {BodyCommand::SetVelocity, e, velocity, 0.0f});
+}
+
+void teleport(flecs::world &world, flecs::entity_t e, b2Vec2 position, float angle) {
+    push_command(world, {BodyCommand::Teleport, e, position, angle});
+}
+
+// Clears the drag when Box2D destroys its joint together with the dragged body
+struct DestructionListener : b2DestructionListener {
+    flecs::world_t *world;
+
+    DestructionListener(flecs::world_t *world) : world(world) {}
+
+    void SayGoodbye(b2Joint *joint) override {
+        auto &drag = flecs::world(world).get_mut<Drag>();
+        if (drag.joint == joint) {
+            drag = {};
+        }
+    }
+
+    void SayGoodbye(b2Fixture *) override {}
+};
+
+void begin_drag(flecs::world &world, flecs::entity_t e, b2Vec2 target) {
+    end_drag(world);
+
+    const BodyPtr *body = flecs::entity(world, e).try_get<BodyPtr>();
+    if (body == nullptr) {
+        return;
+    }
+
+    auto &p_world = world.get<PhysicsWorld>();
+    b2MouseJointDef def;
+    def.bodyA = p_world.ground;
+    def.bodyB = body->ptr;
+    def.target = target;
+    def.maxForce = 1000.0f * body->ptr->GetMass();
+    b2LinearStiffness(def.stiffness, def.damping, 5.0f, 0.7f, def.bodyA, def.bodyB);
+
+    auto &drag = world.get_mut<Drag>();
+    drag.entity = e;
+    drag.joint = (b2MouseJoint *)p_world.ptr->CreateJoint(&def);
+    body->ptr->SetAwake(true);
+}
+
+void update_drag(flecs::world &world, b2Vec2 target) {
+    auto &drag = world.get_mut<Drag>();
+    if (drag.joint != nullptr) {
+        drag.joint->SetTarget(target);
+    }
+}
+
+void end_drag(flecs::world &world) {
+    auto &drag = world.get_mut<Drag>();
+    if (drag.joint != nullptr) {
+        world.get<PhysicsWorld>().ptr->DestroyJoint(drag.joint);
+    }
+    drag = {};
+}
+
+static void drain_commands(flecs::world &world, Commands &commands) {
+    for (auto &stage : commands.stages) {
+        for (auto &command : stage) {
+            flecs::entity e{world, command.entity};
+            if (!e.is_alive()) {
+                continue;
+            }
+            const BodyPtr *body = e.try_get<BodyPtr>();
+            if (body == nullptr) {
+                continue;
+            }
+
+            switch (command.kind) {
+            case BodyCommand::ApplyImpulse:
+                body->ptr->ApplyLinearImpulseToCenter(command.value, true);
+                break;
+            case BodyCommand::ApplyForce:
+                body->ptr->ApplyForceToCenter(command.value, true);
+                break;
+            case BodyCommand::SetVelocity:
+                body->ptr->SetLinearVelocity(command.value);
+                body->ptr->SetAwake(true);
+                break;
+            case BodyCommand::Teleport:
+                body->ptr->SetTransform(command.value, command.angle);
+                body->ptr->SetAwake(true);
+                break;
+            }
+        }
+        stage.clear();
+    }
+
+    // Pick up thread count changes while no other stage can be appending
+    commands.stages.resize(world.get_stage_count());
+}
+
+// Trade solver quality for time while stepping is over budget, one notch per frame. Iterations are
+// lowered before substeps and restored in the opposite order.
+static void adapt_quality(const PhysicsSettings &settings, PhysicsLoad &load) {
+    if (!settings.adaptive) {
+        load.substeps = settings.substeps;
+        load.velocity_iterations = settings.velocity_iterations;
+        load.position_iterations = settings.position_iterations;
+        return;
+    }
+
+    // Settings may have been lowered below the current quality
+    load.substeps = std::min(load.substeps, settings.substeps);
+    load.velocity_iterations = std::min(load.velocity_iterations, settings.velocity_iterations);
+    load.position_iterations = std::min(load.position_iterations, settings.position_iterations);
+
+    if (load.step_ms > settings.budget_ms) {
+        if (load.velocity_iterations > settings.min_velocity_iterations) {
+            load.velocity_iterations--;
+        } else if (load.position_iterations > settings.min_position_iterations) {
+            load.position_iterations--;
+        } else if (load.substeps > 1) {
+            load.substeps--;
+        }
+    } else if (load.step_ms < settings.budget_ms * 0.5f) {
+        if (load.substeps < settings.substeps) {
+            load.substeps++;
+        } else if (load.position_iterations < settings.position_iterations) {
+            load.position_iterations++;
+        } else if (load.velocity_iterations < settings.velocity_iterations) {
+            load.velocity_iterations++;
+        }
+    }
+}
+
 module::module(flecs::world &world) {
+    world.component<PhysicsWorld>().on_remove([](PhysicsWorld &p_world) {
+        delete p_world.ptr;
+        delete p_world.contact_listener;
+        delete p_world.destruction_listener;
+    });
+
+    // Deleting an entity or removing its BodyPtr releases the body. During world teardown the
+    // bodies are left to the b2World destructor.
+    world.component<BodyPtr>().on_remove([](flecs::entity e, BodyPtr &body) {
+        flecs::world world = e.world();
+        if (world.is_fini() || body.ptr == nullptr) {
+            return;
+        }
+        if (PhysicsWorld *p_world = world.try_get_mut<PhysicsWorld>()) {
+            release_body(world, *p_world, body.ptr);
+        }
+    });
+
     b2Vec2 gravity{0.0f, -10.0f};
     b2World *b_world = new b2World(gravity);
-    world.set<PhysicsWorld>({b_world});
+    b2BodyDef ground_def;
+    b2Body *ground = b_world->CreateBody(&ground_def);
+    auto *contact_listener = new ContactListener();
+    auto *destruction_listener = new DestructionListener(world.c_ptr());
+    world.set<PhysicsWorld>({b_world, ground, contact_listener, destruction_listener});
+    world.set<Drag>({});
+
+    b_world->SetDestructionListener(destruction_listener);
+    b_world->SetContactListener(contact_listener);
+
+    world.component<ContactBatch>().member<uint32_t>("count");
+    world.component<ContactFilter>()
+        .member<uint16_t>("categories")
+        .member<bool>("begin")
+        .member<bool>("end")
+        .member<bool>("impacts")
+        .member<float>("min_impulse");
+    world.ensure<ContactFilter>();
+    world.set<Contacts>({});
+
+    Commands commands;
+    commands.stages.resize(world.get_stage_count());
+    world.set<Commands>(std::move(commands));
 
     world.observer<Quad, DynamicBody>()
         .without<BodyPtr>()
         .event(flecs::OnSet)
         .each([](flecs::entity e, Quad &rect, DynamicBody &def) {
-            b2World *p_world = e.world().ensure<PhysicsWorld>().ptr;
+            PhysicsWorld &p_world = e.world().ensure<PhysicsWorld>();
             Position &pos = e.ensure<Position>();
 
-            // Create dynamic box
-            b2BodyDef body_def;
-            body_def.type = b2_dynamicBody;
-            body_def.position.Set(pos.x, pos.y);
-            b2Body *body = p_world->CreateBody(&body_def);
-
-            b2PolygonShape box;
-            box.SetAsBox(rect.width / 2.0f, rect.height / 2.0f);
-
-            b2FixtureDef box_fixture;
-            box_fixture.shape = &box;
-            box_fixture.density = def.density;
-            box_fixture.friction = def.friction;
-
-            body->CreateFixture(&box_fixture);
-
+            b2Body *body =
+                create_box(p_world, e, b2_dynamicBody, pos, rect, def.density, def.friction);
             e.set<BodyPtr>({body});
         });
 
@@ -38,26 +529,33 @@ module::module(flecs::world &world) {
         .without<BodyPtr>()
         .event(flecs::OnSet)
         .each([](flecs::entity e, Circle &circle, DynamicBody &def) {
-            b2World *p_world = e.world().ensure<PhysicsWorld>().ptr;
+            PhysicsWorld &p_world = e.world().ensure<PhysicsWorld>();
             Position &pos = e.ensure<Position>();
 
-            // Create dynamic box
-            b2BodyDef body_def;
-            body_def.type = b2_dynamicBody;
-            body_def.position.Set(pos.x, pos.y);
-            b2Body *body = p_world->CreateBody(&body_def);
+            b2Body *body =
+                create_circle(p_world, e, b2_dynamicBody, pos, circle, def.density, def.friction);
+            e.set<BodyPtr>({body});
+        });
 
-            b2CircleShape shape;
-            // shape.m_p.Set(pos.x, pos.y);
-            shape.m_radius = circle.radius;
+    world.observer<Shapes, DynamicBody>()
+        .without<BodyPtr>()
+        .event(flecs::OnSet)
+        .each([](flecs::entity e, Shapes &shapes, DynamicBody) {
+            PhysicsWorld &p_world = e.world().ensure<PhysicsWorld>();
+            Position &pos = e.ensure<Position>();
 
-            b2FixtureDef fixture;
-            fixture.shape = &shape;
-            fixture.density = def.density;
-            fixture.friction = def.friction;
+            b2Body *body = create_compound(p_world, e, b2_dynamicBody, pos, shapes);
+            e.set<BodyPtr>({body});
+        });
 
-            body->CreateFixture(&fixture);
+    world.observer<Shapes, StaticBody>()
+        .without<BodyPtr>()
+        .event(flecs::OnSet)
+        .each([](flecs::entity e, Shapes &shapes, StaticBody) {
+            PhysicsWorld &p_world = e.world().ensure<PhysicsWorld>();
+            Position &pos = e.ensure<Position>();
 
+            b2Body *body = create_compound(p_world, e, b2_staticBody, pos, shapes);
             e.set<BodyPtr>({body});
         });
 
@@ -65,39 +563,122 @@ module::module(flecs::world &world) {
         .without<BodyPtr>()
         .event(flecs::OnSet)
         .each([](flecs::entity e, Quad &rect, StaticBody) {
-            b2World *p_world = e.world().ensure<PhysicsWorld>().ptr;
+            PhysicsWorld &p_world = e.world().ensure<PhysicsWorld>();
             Position &pos = e.ensure<Position>();
 
-            // Create static box
-            b2BodyDef body_def;
-            body_def.type = b2_staticBody;
-            body_def.position.Set(pos.x, pos.y);
-            b2Body *body = p_world->CreateBody(&body_def);
-
-            b2PolygonShape box;
-            box.SetAsBox(rect.width / 2.0f, rect.height / 2.0f);
-            body->CreateFixture(&box, 0.0f);
-
+            b2Body *body = create_box(p_world, e, b2_staticBody, pos, rect, 0.0f, 0.2f);
             e.set<BodyPtr>({body});
         });
 
-    world.system<BodyPtr, Impulse>().each([](flecs::entity e, BodyPtr &body, Impulse &impulse) {
-        b2Vec2 vec{impulse.x * 300.0f, impulse.y * 300.0f};
-        body.ptr->ApplyLinearImpulseToCenter(vec, true);
-        e.remove<Impulse>();
-    });
+    world.component<PhysicsSettings>()
+        .member<float>("time_step")
+        .member<int32_t>("substeps")
+        .member<int32_t>("velocity_iterations")
+        .member<int32_t>("position_iterations")
+        .member<bool>("allow_sleeping")
+        .member<bool>("continuous")
+        .member<bool>("sub_stepping")
+        .member<bool>("warm_starting")
+        .member<bool>("adaptive")
+        .member<float>("budget_ms")
+        .member<int32_t>("min_velocity_iterations")
+        .member<int32_t>("min_position_iterations");
+    world.component<PhysicsLoad>()
+        .member<float>("step_ms")
+        .member<int32_t>("substeps")
+        .member<int32_t>("velocity_iterations")
+        .member<int32_t>("position_iterations");
+
+    // Adaptive stepping starts from the full configured quality and lowers it from there
+    PhysicsSettings settings = world.ensure<PhysicsSettings>();
+    world.set<PhysicsLoad>({0.0f, settings.substeps, settings.velocity_iterations,
+                            settings.position_iterations});
+
+    world.system<PhysicsWorld, Commands, const PhysicsSettings, PhysicsLoad>()
+        .term_at(1)
+        .singleton()
+        .term_at(2)
+        .singleton()
+        .term_at(3)
+        .singleton()
+        .each([](flecs::entity e, PhysicsWorld &p_world, Commands &commands,
+                 const PhysicsSettings &settings, PhysicsLoad &load) {
+            flecs::world world = e.world();
+            drain_commands(world, commands);
+
+            b2World *b_world = p_world.ptr;
+            b_world->SetAllowSleeping(settings.allow_sleeping);
+            b_world->SetContinuousPhysics(settings.continuous);
+            b_world->SetSubStepping(settings.sub_stepping);
+            b_world->SetWarmStarting(settings.warm_starting);
+
+            adapt_quality(settings, load);
+            int32_t substeps = std::max(load.substeps, 1);
+            float dt = settings.time_step / (float)substeps;
+
+            ContactListener &listener = *p_world.contact_listener;
+            listener.filter = world.get<ContactFilter>();
 
-    world.system<PhysicsWorld>().each(
-        [](PhysicsWorld &p_world) { p_world.ptr->Step(1.0f / 60.0f, 8, 3); });
+            // Forces from this frame's commands act on every substep, not just the first
+            b_world->SetAutoClearForces(false);
+            auto start = std::chrono::steady_clock::now();
+            for (int32_t i = 0; i < substeps; i++) {
+                b_world->Step(dt, load.velocity_iterations, load.position_iterations);
+            }
+            b_world->ClearForces();
+            std::chrono::duration<float, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+            load.step_ms += (elapsed.count() - load.step_ms) * 0.2f;
 
-    world.system<BodyPtr, Position>().with<DynamicBody>().each(
-        [](BodyPtr &body, Position &position) {
+            // Hand out the whole step at once
+            auto &contacts = world.get_mut<Contacts>();
+            std::swap(contacts.events, listener.pending);
+            listener.pending.clear();
+            if (!contacts.events.empty()) {
+                world.entity<Contacts>().emit<ContactBatch>({(uint32_t)contacts.events.size()});
+            }
+        });
+
+    world.system<const BodyPtr, Position>()
+        .with<DynamicBody>()
+        .without<Sleeping>()
+        .each([](flecs::entity e, const BodyPtr &body, Position &position) {
             auto pos = body.ptr->GetPosition();
             auto rot = body.ptr->GetAngle();
             position.x = pos.x;
             position.y = pos.y;
             position.rotation = rot;
+            if (!body.ptr->IsAwake()) {
+                e.add<Sleeping>();
+            }
         });
+
+    world.component<DebugDraw>()
+        .member<bool>("shapes")
+        .member<bool>("joints")
+        .member<bool>("aabbs")
+        .member<bool>("centers_of_mass")
+        .member<bool>("contacts");
+    world.set<DebugDraw>({});
+
+    // Captured once everything moved for the frame
+    world.system<const PhysicsWorld, const DebugDraw>()
+        .term_at(1)
+        .singleton()
+        .kind(flecs::PostUpdate)
+        .each([](flecs::entity e, const PhysicsWorld &p_world, const DebugDraw &draw) {
+            if (draw.enabled()) {
+                flecs::world world = e.world();
+                capture_debug_draw(world, p_world, draw);
+            }
+        });
+
+    // Bodies woken by contacts, joints or commands move back to the synced tables
+    world.system<const BodyPtr>().with<Sleeping>().each([](flecs::entity e, const BodyPtr &body) {
+        if (body.ptr->IsAwake()) {
+            e.remove<Sleeping>();
+        }
+    });
 }
 
 } // namespace physics
\ No newline at end of file
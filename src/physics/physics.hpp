@@ -1,7 +1,12 @@
 #pragma once
 
 #include "flecs.h"
+#include "../common.hpp"
+#include <algorithm>
 #include <box2d/box2d.h>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
 
 struct DynamicBody {
     float density;
@@ -10,10 +15,9 @@ struct DynamicBody {
 
 struct StaticBody {};
 
-struct Impulse {
-    float x;
-    float y;
-};
+// Dynamic body Box2D put to sleep. Positions of sleeping bodies aren't synced, so their tables
+// stay unchanged and renderers can skip them.
+struct Sleeping {};
 
 namespace physics {
 
@@ -21,10 +25,279 @@ struct BodyPtr {
     b2Body *ptr;
 };
 
+// Everything that has to match for a pooled body to stand in for a newly created one
+struct BodyKey {
+    b2BodyType type;
+    b2Shape::Type shape;
+    // Box extents, or the diameter for circles
+    float width;
+    float height;
+    float density;
+    float friction;
+
+    bool operator==(const BodyKey &other) const {
+        return type == other.type && shape == other.shape && width == other.width &&
+               height == other.height && density == other.density && friction == other.friction;
+    }
+
+    struct Hash {
+        size_t operator()(const BodyKey &key) const {
+            size_t hash = std::hash<float>()(key.width);
+            hash = hash * 31 + std::hash<float>()(key.height);
+            hash = hash * 31 + std::hash<float>()(key.density);
+            hash = hash * 31 + std::hash<float>()(key.friction);
+            return hash * 31 + (size_t)key.type * 4 + (size_t)key.shape;
+        }
+    };
+};
+
+// Disabled bodies of removed entities, kept around so spawning a matching shape doesn't have to
+// allocate a new body and fixture. Only single fixture boxes and circles are pooled.
+struct BodyPool {
+    static constexpr size_t max_per_key = 1024;
+
+    std::unordered_map<BodyKey, std::vector<b2Body *>, BodyKey::Hash> bodies;
+    size_t count = 0;
+
+    b2Body *acquire(const BodyKey &key) {
+        auto it = bodies.find(key);
+        if (it == bodies.end() || it->second.empty()) {
+            return nullptr;
+        }
+        b2Body *body = it->second.back();
+        it->second.pop_back();
+        count--;
+        return body;
+    }
+
+    // Returns false when the pool for the key is full and the body should be destroyed
+    bool release(const BodyKey &key, b2Body *body) {
+        auto &free = bodies[key];
+        if (free.size() >= max_per_key) {
+            return false;
+        }
+        free.push_back(body);
+        count++;
+        return true;
+    }
+};
+
+// Contact between the fixtures of two entities, recorded while stepping
+struct ContactEvent {
+    enum Kind : uint8_t { Begin, End, Impact };
+
+    Kind kind;
+    // Zero for bodies without an entity, such as bodies released while still touching
+    flecs::entity_t a;
+    flecs::entity_t b;
+    // World space contact point and normal from a to b, zero for End events
+    b2Vec2 point;
+    b2Vec2 normal;
+    // Largest normal impulse applied to the contact points, Impact events only
+    float impulse;
+};
+
+// Contacts reported by the last step, replaced after every step and announced with a single
+// ContactBatch event on this singleton. Entities may have been deleted since they were recorded.
+struct Contacts {
+    std::vector<ContactEvent> events;
+};
+
+struct ContactBatch {
+    uint32_t count;
+};
+
+// Which contacts are recorded. A pair is recorded when either fixture has one of the category
+// bits. Box2D reports impulses for every solved contact each step, so impacts are opt in.
+struct ContactFilter {
+    uint16_t categories = 0xFFFF;
+    bool begin = true;
+    bool end = true;
+    bool impacts = false;
+    float min_impulse = 0.0f;
+};
+
+// Buffers contacts while Box2D is stepping so nothing calls into flecs from inside the solver.
+// End events from bodies released between steps are buffered too and go out with the next step,
+// with 0 in place of the deleted entity.
+struct ContactListener : b2ContactListener {
+    ContactFilter filter;
+    std::vector<ContactEvent> pending;
+
+    bool accept(b2Contact *contact) const {
+        uint16 categories = contact->GetFixtureA()->GetFilterData().categoryBits |
+                            contact->GetFixtureB()->GetFilterData().categoryBits;
+        return (categories & filter.categories) != 0;
+    }
+
+    void record(ContactEvent::Kind kind, b2Contact *contact, float impulse) {
+        ContactEvent event{kind,
+                           contact->GetFixtureA()->GetBody()->GetUserData().pointer,
+                           contact->GetFixtureB()->GetBody()->GetUserData().pointer,
+                           b2Vec2_zero,
+                           b2Vec2_zero,
+                           impulse};
+        if (kind != ContactEvent::End && contact->GetManifold()->pointCount > 0) {
+            b2WorldManifold manifold;
+            contact->GetWorldManifold(&manifold);
+            event.point = manifold.points[0];
+            event.normal = manifold.normal;
+        }
+        pending.push_back(event);
+    }
+
+    void BeginContact(b2Contact *contact) override {
+        if (filter.begin && accept(contact)) {
+            record(ContactEvent::Begin, contact, 0.0f);
+        }
+    }
+
+    void EndContact(b2Contact *contact) override {
+        if (filter.end && accept(contact)) {
+            record(ContactEvent::End, contact, 0.0f);
+        }
+    }
+
+    void PostSolve(b2Contact *contact, const b2ContactImpulse *impulse) override {
+        if (!filter.impacts || !accept(contact)) {
+            return;
+        }
+        float largest = 0.0f;
+        for (int32 i = 0; i < impulse->count; i++) {
+            largest = std::max(largest, impulse->normalImpulses[i]);
+        }
+        if (largest >= filter.min_impulse) {
+            record(ContactEvent::Impact, contact, largest);
+        }
+    }
+};
+
 struct PhysicsWorld {
     b2World *ptr;
+    // Static body without fixtures used as the anchor for mouse joints
+    b2Body *ground = nullptr;
+    ContactListener *contact_listener = nullptr;
+    // Clears the drag when Box2D destroys its joint
+    b2DestructionListener *destruction_listener = nullptr;
+    BodyPool pool;
 };
 
+// Solver configuration, read every step. Sleep tolerances are compile time constants in Box2D
+// 2.4, so only sleeping as a whole can be toggled.
+struct PhysicsSettings {
+    float time_step = 1.0f / 60.0f;
+    // Steps of time_step / substeps each frame
+    int32_t substeps = 1;
+    int32_t velocity_iterations = 8;
+    int32_t position_iterations = 3;
+    bool allow_sleeping = true;
+    // Time of impact solving for fast bodies, and stepping it one contact at a time
+    bool continuous = true;
+    bool sub_stepping = false;
+    bool warm_starting = true;
+
+    // Lower the quality when stepping takes longer than the budget, restore it once stepping
+    // takes less than half of it
+    bool adaptive = true;
+    float budget_ms = 4.0f;
+    int32_t min_velocity_iterations = 2;
+    int32_t min_position_iterations = 1;
+};
+
+// Quality the world is currently stepped with and the smoothed time spent stepping
+struct PhysicsLoad {
+    float step_ms = 0.0f;
+    int32_t substeps = 1;
+    int32_t velocity_iterations = 8;
+    int32_t position_iterations = 3;
+};
+
+// Body being dragged towards a target with a mouse joint
+struct Drag {
+    flecs::entity_t entity = 0;
+    b2MouseJoint *joint = nullptr;
+};
+
+// Box2D internals drawn as debug lines. Toggles can be changed from the explorer, nothing is
+// captured while they are all off.
+struct DebugDraw {
+    bool shapes = false;
+    bool joints = false;
+    bool aabbs = false;
+    bool centers_of_mass = false;
+    bool contacts = false;
+
+    bool enabled() const { return shapes || joints || aabbs || centers_of_mass || contacts; }
+};
+
+// Box2D state not covered by the flecs components, captured in snapshots
+struct BodyState {
+    b2Vec2 linear_velocity;
+    float angular_velocity;
+    uint32_t awake;
+};
+
+struct BodyCommand {
+    enum Kind : uint8_t { ApplyImpulse, ApplyForce, SetVelocity, Teleport };
+
+    Kind kind;
+    flecs::entity_t entity;
+    b2Vec2 value;
+    float angle;
+};
+
+// Per-stage body command buffers, drained once right before the world is stepped. Every stage
+// only appends to its own buffer, so systems running on worker threads can enqueue without locks.
+struct Commands {
+    std::vector<std::vector<BodyCommand>> stages;
+};
+
+// Queue a command for the body of an entity. Commands for entities that no longer have a body
+// when the queue is drained are dropped.
+void apply_impulse(flecs::world &world, flecs::entity_t e, b2Vec2 impulse);
+void apply_force(flecs::world &world, flecs::entity_t e, b2Vec2 force);
+void set_velocity(flecs::world &world, flecs::entity_t e, b2Vec2 velocity);
+void teleport(flecs::world &world, flecs::entity_t e, b2Vec2 position, float angle);
+
+// Start dragging the body of an entity towards target, replacing any active drag
+void begin_drag(flecs::world &world, flecs::entity_t e, b2Vec2 target);
+void update_drag(flecs::world &world, b2Vec2 target);
+void end_drag(flecs::world &world);
+
+// Create a body with a single fixture, storing the owning entity in the body user data
+b2Body *create_body(b2World *world, flecs::entity_t e, b2BodyType type, const Position &pos,
+                    const b2Shape &shape, float density, float friction);
+
+// Create a box or circle body, reusing a pooled body with the same shape when there is one
+b2Body *create_box(PhysicsWorld &world, flecs::entity_t e, b2BodyType type, const Position &pos,
+                   const Quad &quad, float density, float friction);
+
+b2Body *create_circle(PhysicsWorld &world, flecs::entity_t e, b2BodyType type,
+                      const Position &pos, const Circle &circle, float density, float friction);
+
+// Create a body with one fixture per part, each with its own material and filter. Parts that
+// can't be turned into a fixture are skipped. Compounds are never taken from the pool, but a
+// single part compound identical to a plain box or circle body is returned to it on release.
+b2Body *create_compound(PhysicsWorld &world, flecs::entity_t e, b2BodyType type,
+                        const Position &pos, const Shapes &shapes);
+
+// Set the collision category and mask bits of every fixture of an entity's body
+void set_collision_filter(flecs::world &world, flecs::entity_t e, uint16_t category,
+                          uint16_t mask = 0xFFFF);
+
+// Destroy the joints of a body and return it to the pool, or destroy it when it can't be pooled.
+// Called by the BodyPtr remove hook, so deleting an entity is enough to clean up its body.
+void release_body(flecs::world &world, PhysicsWorld &p_world, b2Body *body);
+
+// Create bodies for `count` shapes in one pass. Bodies are dynamic when defs is set and static
+// otherwise. Exactly one of quads or circles must be set, states is optional.
+void create_bodies(PhysicsWorld &world, int32_t count, const Position *positions,
+                   const Quad *quads, const Circle *circles, const DynamicBody *defs,
+                   const BodyState *states, BodyPtr *out);
+
+// Capture the enabled DebugDraw layers into the rendering::DebugLines singleton, if there is one
+void capture_debug_draw(flecs::world &world, const PhysicsWorld &p_world, const DebugDraw &draw);
+
 struct module {
     module(flecs::world &world);
 };
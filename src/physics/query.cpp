@@ -0,0 +1,233 @@
+#include "query.hpp"
+#include "physics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace physics {
+
+// Above this ratio of union area to summed query area a batch is resolved query by query, since a
+// single traversal of the union would visit most of the tree for little shared work.
+constexpr float sparse_batch_ratio = 8.0f;
+
+flecs::entity_t body_entity(b2Body *body) { return (flecs::entity_t)body->GetUserData().pointer; }
+
+static float area(const b2AABB &aabb) {
+    b2Vec2 extents = aabb.upperBound - aabb.lowerBound;
+    return extents.x * extents.y;
+}
+
+static bool fixture_overlaps(b2Fixture *fixture, const b2AABB &aabb) {
+    for (int32 child = 0; child < fixture->GetShape()->GetChildCount(); child++) {
+        if (b2TestOverlap(fixture->GetAABB(child), aabb)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bodies with several fixtures report the same entity more than once
+static void unique_tail(std::vector<flecs::entity_t> &out, size_t start) {
+    std::sort(out.begin() + start, out.end());
+    out.erase(std::unique(out.begin() + start, out.end()), out.end());
+}
+
+struct AABBCallback : b2QueryCallback {
+    const b2AABB &aabb;
+    std::vector<flecs::entity_t> &out;
+
+    AABBCallback(const b2AABB &aabb, std::vector<flecs::entity_t> &out) : aabb(aabb), out(out) {}
+
+    bool ReportFixture(b2Fixture *fixture) override {
+        flecs::entity_t e = body_entity(fixture->GetBody());
+        if (e != 0 && fixture_overlaps(fixture, aabb)) {
+            out.push_back(e);
+        }
+        return true;
+    }
+};
+
+struct PointCallback : b2QueryCallback {
+    b2Vec2 point;
+    std::vector<flecs::entity_t> &out;
+
+    PointCallback(b2Vec2 point, std::vector<flecs::entity_t> &out) : point(point), out(out) {}
+
+    bool ReportFixture(b2Fixture *fixture) override {
+        flecs::entity_t e = body_entity(fixture->GetBody());
+        if (e != 0 && fixture->TestPoint(point)) {
+            out.push_back(e);
+        }
+        return true;
+    }
+};
+
+struct RayCallback : b2RayCastCallback {
+    RayHit &hit;
+    bool found = false;
+
+    RayCallback(RayHit &hit) : hit(hit) {}
+
+    float ReportFixture(b2Fixture *fixture, const b2Vec2 &point, const b2Vec2 &normal,
+                        float fraction) override {
+        flecs::entity_t e = body_entity(fixture->GetBody());
+        if (e == 0) {
+            return -1.0f;
+        }
+        hit = {e, point, normal, fraction};
+        found = true;
+        // Clip the ray to this hit so only closer fixtures are reported
+        return fraction;
+    }
+};
+
+struct Candidate {
+    b2AABB aabb;
+    flecs::entity_t entity;
+};
+
+struct CandidateCallback : b2QueryCallback {
+    std::vector<Candidate> &out;
+
+    CandidateCallback(std::vector<Candidate> &out) : out(out) {}
+
+    bool ReportFixture(b2Fixture *fixture) override {
+        flecs::entity_t e = body_entity(fixture->GetBody());
+        if (e != 0) {
+            for (int32 child = 0; child < fixture->GetShape()->GetChildCount(); child++) {
+                out.push_back({fixture->GetAABB(child), e});
+            }
+        }
+        return true;
+    }
+};
+
+void query_aabb(flecs::world &world, const b2AABB &aabb, std::vector<flecs::entity_t> &out) {
+    b2World *p_world = world.get<PhysicsWorld>().ptr;
+    size_t start = out.size();
+    AABBCallback callback{aabb, out};
+    p_world->QueryAABB(&callback, aabb);
+    unique_tail(out, start);
+}
+
+void query_point(flecs::world &world, b2Vec2 point, std::vector<flecs::entity_t> &out) {
+    b2World *p_world = world.get<PhysicsWorld>().ptr;
+    size_t start = out.size();
+    b2AABB aabb;
+    aabb.lowerBound = point - b2Vec2{b2_linearSlop, b2_linearSlop};
+    aabb.upperBound = point + b2Vec2{b2_linearSlop, b2_linearSlop};
+    PointCallback callback{point, out};
+    p_world->QueryAABB(&callback, aabb);
+    unique_tail(out, start);
+}
+
+bool raycast(flecs::world &world, b2Vec2 from, b2Vec2 to, RayHit &hit) {
+    b2World *p_world = world.get<PhysicsWorld>().ptr;
+    RayCallback callback{hit};
+    p_world->RayCast(&callback, from, to);
+    return callback.found;
+}
+
+// Uniform grid of query indices covering the union of a batch
+struct QueryGrid {
+    b2Vec2 origin;
+    b2Vec2 scale;
+    int32_t cells;
+    std::vector<std::vector<uint32_t>> bins;
+
+    int32_t cell(float value, float start, float step) const {
+        return std::clamp((int32_t)((value - start) * step), 0, cells - 1);
+    }
+
+    int32_t cell_x(float x) const { return cell(x, origin.x, scale.x); }
+    int32_t cell_y(float y) const { return cell(y, origin.y, scale.y); }
+};
+
+void query_batch(flecs::world &world, QueryBatch &batch) {
+    uint32_t count = (uint32_t)batch.queries.size();
+    batch.offsets.assign(count + 1, 0);
+    batch.entities.clear();
+    if (count == 0) {
+        return;
+    }
+
+    b2AABB bounds = batch.queries[0];
+    float query_area = 0.0f;
+    for (auto &query : batch.queries) {
+        bounds.Combine(query);
+        query_area += area(query);
+    }
+
+    std::vector<std::pair<uint32_t, flecs::entity_t>> pairs;
+    if (area(bounds) > sparse_batch_ratio * query_area) {
+        std::vector<flecs::entity_t> result;
+        for (uint32_t i = 0; i < count; i++) {
+            result.clear();
+            query_aabb(world, batch.queries[i], result);
+            for (auto e : result) {
+                pairs.push_back({i, e});
+            }
+        }
+    } else {
+        b2World *p_world = world.get<PhysicsWorld>().ptr;
+        std::vector<Candidate> candidates;
+        CandidateCallback callback{candidates};
+        p_world->QueryAABB(&callback, bounds);
+
+        QueryGrid grid;
+        grid.cells = std::max(1, (int32_t)std::sqrt((float)count));
+        grid.origin = bounds.lowerBound;
+        b2Vec2 extents = bounds.upperBound - bounds.lowerBound;
+        grid.scale.x = extents.x > 0.0f ? grid.cells / extents.x : 0.0f;
+        grid.scale.y = extents.y > 0.0f ? grid.cells / extents.y : 0.0f;
+        grid.bins.resize(grid.cells * grid.cells);
+
+        for (uint32_t i = 0; i < count; i++) {
+            auto &query = batch.queries[i];
+            for (int32_t y = grid.cell_y(query.lowerBound.y); y <= grid.cell_y(query.upperBound.y);
+                 y++) {
+                for (int32_t x = grid.cell_x(query.lowerBound.x);
+                     x <= grid.cell_x(query.upperBound.x); x++) {
+                    grid.bins[y * grid.cells + x].push_back(i);
+                }
+            }
+        }
+
+        for (auto &candidate : candidates) {
+            auto &aabb = candidate.aabb;
+            for (int32_t y = grid.cell_y(aabb.lowerBound.y); y <= grid.cell_y(aabb.upperBound.y);
+                 y++) {
+                for (int32_t x = grid.cell_x(aabb.lowerBound.x);
+                     x <= grid.cell_x(aabb.upperBound.x); x++) {
+                    for (uint32_t i : grid.bins[y * grid.cells + x]) {
+                        auto &query = batch.queries[i];
+                        if (!b2TestOverlap(aabb, query)) {
+                            continue;
+                        }
+                        // A pair can share several cells, only report it from the cell holding
+                        // the lower corner of the overlap
+                        float min_x = std::max(aabb.lowerBound.x, query.lowerBound.x);
+                        float min_y = std::max(aabb.lowerBound.y, query.lowerBound.y);
+                        if (grid.cell_x(min_x) == x && grid.cell_y(min_y) == y) {
+                            pairs.push_back({i, candidate.entity});
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    batch.entities.reserve(pairs.size());
+    for (auto &pair : pairs) {
+        batch.offsets[pair.first + 1]++;
+        batch.entities.push_back(pair.second);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        batch.offsets[i + 1] += batch.offsets[i];
+    }
+}
+
+} // namespace physics
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "flecs.h"
+#include <box2d/box2d.h>
+#include <vector>
+
+namespace physics {
+
+// Entity stored in the user data of a body, 0 for bodies not owned by an entity
+flecs::entity_t body_entity(b2Body *body);
+
+// Append entities with a fixture overlapping the box
+void query_aabb(flecs::world &world, const b2AABB &aabb, std::vector<flecs::entity_t> &out);
+
+// Append entities with a fixture containing the point
+void query_point(flecs::world &world, b2Vec2 point, std::vector<flecs::entity_t> &out);
+
+struct RayHit {
+    flecs::entity_t entity;
+    b2Vec2 point;
+    b2Vec2 normal;
+    float fraction;
+};
+
+// Find the closest fixture along the ray, returns false if nothing was hit
+bool raycast(flecs::world &world, b2Vec2 from, b2Vec2 to, RayHit &hit);
+
+// AABB queries submitted together so clustered queries share a single broadphase traversal.
+// Results are stored flattened: the entities for query i are entities[offsets[i], offsets[i + 1]).
+struct QueryBatch {
+    std::vector<b2AABB> queries;
+    std::vector<uint32_t> offsets;
+    std::vector<flecs::entity_t> entities;
+
+    void add(const b2AABB &aabb) { queries.push_back(aabb); }
+
+    void clear() {
+        queries.clear();
+        offsets.clear();
+        entities.clear();
+    }
+};
+
+void query_batch(flecs::world &world, QueryBatch &batch);
+
+} // namespace physics
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "flecs.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace rendering {
+
+// Linear allocator for data that only lives until the end of the frame. Nothing is freed
+// individually, reset() releases everything at once. Memory that overflowed into extra blocks is
+// merged into a single block on reset, so after the first frames no heap allocations are made.
+struct Arena {
+    static constexpr size_t initial_size = 64 * 1024;
+
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    // Offset into the last block
+    size_t offset = 0;
+    // Bytes handed out since the last reset and the most handed out in any frame
+    size_t used = 0;
+    size_t peak = 0;
+
+    void *allocate(size_t size, size_t align) {
+        if (!blocks.empty()) {
+            Block &block = blocks.back();
+            size_t start = (offset + align - 1) & ~(align - 1);
+            if (start + size <= block.size) {
+                offset = start + size;
+                used += size;
+                return block.data.get() + start;
+            }
+        }
+
+        size_t block_size = blocks.empty() ? initial_size : blocks.back().size * 2;
+        block_size = std::max(block_size, size + align);
+        blocks.push_back({std::make_unique<uint8_t[]>(block_size), block_size});
+        offset = 0;
+        return allocate(size, align);
+    }
+
+    void reset() {
+        if (blocks.size() > 1) {
+            size_t total = 0;
+            for (auto &block : blocks) {
+                total += block.size;
+            }
+            blocks.clear();
+            blocks.push_back({std::make_unique<uint8_t[]>(total), total});
+        }
+        offset = 0;
+        peak = std::max(peak, used);
+        used = 0;
+    }
+};
+
+// STL allocator handing out arena memory, deallocation is a no-op
+template <typename T> struct ArenaAllocator {
+    using value_type = T;
+
+    Arena *arena;
+
+    ArenaAllocator(Arena &arena) : arena(&arena) {}
+    template <typename U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count) { return (T *)arena->allocate(count * sizeof(T), alignof(T)); }
+    void deallocate(T *, size_t) {}
+
+    template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+        return arena == other.arena;
+    }
+    template <typename U> bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena != other.arena;
+    }
+};
+
+// Vector for transient per-frame data, must not be kept past the end of the frame
+template <typename T> using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+// One arena per stage so systems running on worker threads don't contend on the heap. Every arena
+// is reset at the start of RenderSystems::Load.
+struct FrameArena {
+    std::vector<Arena> stages;
+};
+
+// Arena of the stage the world belongs to
+inline Arena &frame_arena(flecs::world &world) {
+    auto &arena = world.get_mut<FrameArena>();
+    size_t stage = (size_t)world.get_stage_id();
+    ecs_assert(stage < arena.stages.size(), ECS_INVALID_OPERATION,
+               "stage count changed during the frame");
+    return arena.stages[stage];
+}
+
+} // namespace rendering
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "flecs.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rendering {
+
+// Image file loaded into ImageData. Quads with a (RenderTexture, image) pair are drawn with the
+// image instead of their Color, which tints the image when set.
+struct Image {
+    std::string path;
+};
+
+// Texel rect an image was packed into on one of the atlas pages, padding excluded
+struct AtlasRegion {
+    uint32_t page;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Images up to max_image_size on both sides share the layers of one atlas texture, larger images
+// fall back to a TextureArray per size. Pages whose removed images waste more than repack_waste of
+// their area are packed again, one page per frame.
+struct AtlasSettings {
+    uint32_t page_size = 2048;
+    uint32_t max_pages = 16;
+    uint32_t max_image_size = 512;
+    float repack_waste = 0.5f;
+};
+
+// Atlas and sprite counts of the last frame, reset before the images are packed
+struct AtlasStats {
+    uint32_t pages;
+    uint32_t images;
+    // Images too large for the atlas and the TextureArrays holding them
+    uint32_t array_images;
+    uint32_t arrays;
+    uint32_t repacked_pages;
+    uint32_t sprites;
+    uint32_t draws;
+};
+
+// Packs rects into a fixed size page by tracking the top edge of everything placed so far. Every
+// rect is placed where its top edge ends up lowest, on the narrowest segment when tied.
+struct SkylinePacker {
+    struct Segment {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+    };
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<Segment> skyline;
+    uint64_t used_area = 0;
+
+    void reset(uint32_t new_width, uint32_t new_height) {
+        width = new_width;
+        height = new_height;
+        skyline = {{0, 0, width}};
+        used_area = 0;
+    }
+
+    // Bottom of a rect placed at the start of the segment, UINT32_MAX if it doesn't fit there
+    uint32_t fit(size_t index, uint32_t rect_width, uint32_t rect_height) const {
+        uint32_t x = skyline[index].x;
+        if (x + rect_width > width) {
+            return UINT32_MAX;
+        }
+        uint32_t y = 0;
+        uint32_t remaining = rect_width;
+        for (size_t i = index; remaining > 0; i++) {
+            y = std::max(y, skyline[i].y);
+            if (y + rect_height > height) {
+                return UINT32_MAX;
+            }
+            remaining -= std::min(remaining, skyline[i].width);
+        }
+        return y;
+    }
+
+    bool insert(uint32_t rect_width, uint32_t rect_height, uint32_t &x, uint32_t &y) {
+        size_t best = SIZE_MAX;
+        uint32_t best_y = UINT32_MAX;
+        uint32_t best_width = UINT32_MAX;
+        for (size_t i = 0; i < skyline.size(); i++) {
+            uint32_t fit_y = fit(i, rect_width, rect_height);
+            if (fit_y < best_y || (fit_y == best_y && fit_y != UINT32_MAX &&
+                                   skyline[i].width < best_width)) {
+                best = i;
+                best_y = fit_y;
+                best_width = skyline[i].width;
+            }
+        }
+        if (best == SIZE_MAX) {
+            return false;
+        }
+
+        x = skyline[best].x;
+        y = best_y;
+        skyline.insert(skyline.begin() + best, {x, y + rect_height, rect_width});
+
+        // Cut the segments now covered by the rect
+        for (size_t i = best + 1; i < skyline.size();) {
+            uint32_t covered_until = skyline[i - 1].x + skyline[i - 1].width;
+            Segment &segment = skyline[i];
+            if (segment.x >= covered_until) {
+                break;
+            }
+            uint32_t overlap = covered_until - segment.x;
+            if (segment.width <= overlap) {
+                skyline.erase(skyline.begin() + i);
+                continue;
+            }
+            segment.x += overlap;
+            segment.width -= overlap;
+            break;
+        }
+
+        for (size_t i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            } else {
+                i++;
+            }
+        }
+
+        used_area += (uint64_t)rect_width * rect_height;
+        return true;
+    }
+};
+
+} // namespace rendering
@@ -0,0 +1,90 @@
+#include "commands.hpp"
+#include <algorithm>
+
+namespace rendering {
+
+static void finish_stage(CommandEncoders::Stage &stage, uint32_t index) {
+    if (stage.encoder == nullptr) {
+        return;
+    }
+    wgpu::CommandBufferDescriptor desc;
+    desc.label = toWgpuStringView("Command buffer");
+    wgpu::CommandBuffer buffer = stage.encoder.finish(desc);
+    stage.encoder.release();
+    stage.encoder = nullptr;
+    stage.finished.push_back({stage.order, index, (uint32_t)stage.finished.size(), buffer});
+}
+
+void CommandEncoders::on_remove(CommandEncoders &value) {
+    for (auto &stage : value.stages) {
+        if (stage.encoder != nullptr) {
+            stage.encoder.release();
+        }
+        for (auto &recorded : stage.finished) {
+            recorded.buffer.release();
+        }
+    }
+    value.stages.clear();
+}
+
+wgpu::CommandEncoder command_encoder(flecs::world &world, int32_t order) {
+    auto &encoders = world.get_mut<CommandEncoders>();
+    uint32_t index = (uint32_t)world.get_stage_id();
+    ecs_assert(index < encoders.stages.size(), ECS_INVALID_OPERATION,
+               "stage count changed during the frame");
+    CommandEncoders::Stage &stage = encoders.stages[index];
+
+    if (stage.encoder != nullptr && stage.order != order) {
+        finish_stage(stage, index);
+    }
+    if (stage.encoder == nullptr) {
+        wgpu::CommandEncoderDescriptor desc;
+        desc.label = toWgpuStringView("Command Encoder");
+        stage.encoder = world.get_mut<WGPU>().device.createCommandEncoder(desc);
+        stage.order = order;
+    }
+    return stage.encoder;
+}
+
+void submit_commands(flecs::world &world) {
+    auto &encoders = world.get_mut<CommandEncoders>();
+    CommandStats &stats = world.get_mut<CommandStats>();
+    stats = {};
+
+    encoders.pending.clear();
+    for (uint32_t i = 0; i < encoders.stages.size(); i++) {
+        CommandEncoders::Stage &stage = encoders.stages[i];
+        finish_stage(stage, i);
+        encoders.pending.insert(encoders.pending.end(), stage.finished.begin(),
+                                stage.finished.end());
+        stage.finished.clear();
+    }
+
+    std::sort(encoders.pending.begin(), encoders.pending.end(),
+              [](const CommandEncoders::Recorded &a, const CommandEncoders::Recorded &b) {
+                  if (a.order != b.order) {
+                      return a.order < b.order;
+                  }
+                  if (a.stage != b.stage) {
+                      return a.stage < b.stage;
+                  }
+                  return a.sequence < b.sequence;
+              });
+
+    encoders.buffers.clear();
+    for (auto &recorded : encoders.pending) {
+        encoders.buffers.push_back(recorded.buffer);
+    }
+    if (!encoders.buffers.empty()) {
+        world.get_mut<WGPU>().queue.submit(encoders.buffers.size(), encoders.buffers.data());
+    }
+    for (auto &buffer : encoders.buffers) {
+        buffer.release();
+    }
+    stats.command_buffers = (uint32_t)encoders.buffers.size();
+
+    // Pick up thread count changes while no other stage is recording
+    encoders.stages.resize(world.get_stage_count());
+}
+
+} // namespace rendering
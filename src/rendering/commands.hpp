@@ -0,0 +1,60 @@
+#pragma once
+
+#include "flecs.h"
+#include "rendering.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace rendering {
+
+// Position of a command buffer in the frame's submit, lower first
+enum SubmitOrder : int32_t {
+    SubmitUpload = -100,  // Copies later work depends on
+    SubmitCompute = -50,  // Compute work recorded outside the render graph
+    SubmitGraph = 0,      // Render graph of the frame
+    SubmitReadback = 100, // Copies out of resources the graph wrote
+};
+
+// One command encoder per stage so systems running on worker threads record without locking. The
+// command buffers of every stage are sent in a single queue submit at the end of
+// RenderSystems::Queue, sorted by order, then by stage, then in the order they were recorded.
+struct CommandEncoders {
+    struct Recorded {
+        int32_t order;
+        uint32_t stage;
+        uint32_t sequence;
+        wgpu::CommandBuffer buffer;
+    };
+
+    struct Stage {
+        // Encoder that's open for the order it was requested with
+        wgpu::CommandEncoder encoder = nullptr;
+        int32_t order = 0;
+        std::vector<Recorded> finished;
+    };
+
+    std::vector<Stage> stages;
+    std::vector<Recorded> pending;
+    std::vector<wgpu::CommandBuffer> buffers;
+
+    CommandEncoders() = default;
+    CommandEncoders(const CommandEncoders &) = delete;
+    CommandEncoders(CommandEncoders &&) = default;
+    CommandEncoders &operator=(CommandEncoders &&) = default;
+
+    static void on_remove(CommandEncoders &value);
+};
+
+// Command buffers handed to the queue in the last submit_commands call, all in one submit
+struct CommandStats {
+    uint32_t command_buffers;
+};
+
+// Encoder of the stage the world belongs to for commands submitted at the given order. Requesting
+// another order finishes the open encoder, so its commands keep their place in the submit.
+wgpu::CommandEncoder command_encoder(flecs::world &world, int32_t order = SubmitGraph);
+
+// Finish the encoders of every stage and send all command buffers in one submit
+void submit_commands(flecs::world &world);
+
+} // namespace rendering
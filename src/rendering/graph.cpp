@@ -0,0 +1,536 @@
+#include "graph.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+
+namespace rendering {
+
+// Texture behind one or more transient textures
+struct PhysicalTexture {
+    RenderTarget target;
+    // Position in the execution order of the last pass using it this frame
+    int32_t busy_until = -1;
+    uint32_t idle_frames = 0;
+};
+
+// Resources of a node are ranges of RenderGraph::resources, reads come right before writes
+struct GraphNode {
+    flecs::entity_t entity;
+    int32_t order;
+    uint32_t reads_begin;
+    uint32_t reads_end;
+    uint32_t writes_begin;
+    uint32_t writes_end;
+    bool live;
+};
+
+// Positions in the execution order of the first and last live pass using a transient texture
+struct TransientUse {
+    flecs::entity_t resource;
+    int32_t first;
+    int32_t last;
+    // Index into RenderGraph::textures for the current frame
+    size_t texture;
+};
+
+// Compiled from the GraphPass entities whenever one of them changes, there are only ever a
+// handful of passes. Everything here is kept between frames so executing the graph doesn't
+// allocate once the vectors grew to fit.
+struct RenderGraph {
+    // Textures unused for this many frames are released
+    static constexpr uint32_t max_idle_frames = 60;
+
+    flecs::query<const GraphPass> passes;
+    flecs::query<const RenderFunction> render_functions;
+    bool compiled = false;
+
+    std::vector<GraphNode> nodes;
+    std::vector<flecs::entity_t> resources;
+    // Resources bound by the pipelines drawn with RenderFunction
+    std::vector<flecs::entity_t> bound;
+    // Node indices in execution order
+    std::vector<size_t> order;
+    std::vector<std::pair<size_t, size_t>> edges;
+    // Sort scratch
+    std::vector<uint32_t> incoming;
+    std::vector<uint8_t> placed;
+
+    // Transient textures used by live passes, in order of first use
+    std::vector<TransientUse> transients;
+    std::vector<PhysicalTexture> textures;
+    // Live nodes recorded into the same render or compute pass
+    std::vector<size_t> group;
+
+    // Views imported for the current frame
+    std::vector<std::pair<flecs::entity_t, wgpu::TextureView>> imported;
+
+    static void on_remove(RenderGraph &value) {
+        for (auto &texture : value.textures) {
+            texture.target.release();
+        }
+    }
+};
+
+static bool contains(const RenderGraph &graph, uint32_t begin, uint32_t end,
+                     flecs::entity_t resource) {
+    auto first = graph.resources.begin() + begin;
+    auto last = graph.resources.begin() + end;
+    return std::find(first, last, resource) != last;
+}
+
+static bool reads(const RenderGraph &graph, const GraphNode &node, flecs::entity_t resource) {
+    return contains(graph, node.reads_begin, node.reads_end, resource);
+}
+
+static bool writes(const RenderGraph &graph, const GraphNode &node, flecs::entity_t resource) {
+    return contains(graph, node.writes_begin, node.writes_end, resource);
+}
+
+static bool before(const GraphNode &a, const GraphNode &b) {
+    if (a.order != b.order) {
+        return a.order < b.order;
+    }
+    return a.entity < b.entity;
+}
+
+// Iterates both queries, which also clears their changed state
+static void collect_nodes(RenderGraph &graph) {
+    graph.bound.clear();
+    graph.render_functions.each([&](flecs::entity e, const RenderFunction &) {
+        e.each<Binds>([&](flecs::entity target) { graph.bound.push_back(target); });
+    });
+
+    graph.nodes.clear();
+    graph.resources.clear();
+    graph.passes.each([&](flecs::entity e, const GraphPass &pass) {
+        GraphNode node{e, pass.order};
+        auto &resources = graph.resources;
+
+        node.reads_begin = (uint32_t)resources.size();
+        resources.insert(resources.end(), pass.reads.begin(), pass.reads.end());
+        if (pass.draws_render_functions) {
+            resources.insert(resources.end(), graph.bound.begin(), graph.bound.end());
+        }
+        node.reads_end = (uint32_t)resources.size();
+
+        node.writes_begin = node.reads_end;
+        resources.insert(resources.end(), pass.writes.begin(), pass.writes.end());
+        for (auto &attachment : pass.colors) {
+            resources.push_back(attachment.resource);
+            if (attachment.resolve != 0) {
+                resources.push_back(attachment.resolve);
+            }
+        }
+        if (pass.depth.resource != 0) {
+            resources.push_back(pass.depth.resource);
+        }
+        node.writes_end = (uint32_t)resources.size();
+        graph.nodes.push_back(node);
+    });
+}
+
+// Writers run before readers, writers of the same resource in tie break order
+static void sort_nodes(RenderGraph &graph) {
+    auto &nodes = graph.nodes;
+    auto &edges = graph.edges;
+    edges.clear();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        for (size_t j = 0; j < nodes.size(); j++) {
+            if (i == j) {
+                continue;
+            }
+            for (uint32_t r = nodes[i].writes_begin; r < nodes[i].writes_end; r++) {
+                flecs::entity_t resource = graph.resources[r];
+                bool read = reads(graph, nodes[j], resource);
+                bool written = writes(graph, nodes[j], resource);
+                // A pass reading what it writes itself reads the writes of earlier passes
+                if ((read && (!written || before(nodes[i], nodes[j]))) ||
+                    (written && before(nodes[i], nodes[j]))) {
+                    edges.push_back({i, j});
+                    break;
+                }
+            }
+        }
+    }
+
+    auto &incoming = graph.incoming;
+    incoming.assign(nodes.size(), 0);
+    for (auto [from, to] : edges) {
+        incoming[to]++;
+    }
+
+    auto &order = graph.order;
+    auto &placed = graph.placed;
+    order.clear();
+    placed.assign(nodes.size(), 0);
+    while (order.size() < nodes.size()) {
+        size_t next = SIZE_MAX;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (!placed[i] && incoming[i] == 0 &&
+                (next == SIZE_MAX || before(nodes[i], nodes[next]))) {
+                next = i;
+            }
+        }
+        if (next == SIZE_MAX) {
+            std::cerr << "Render graph has a cycle, remaining passes run in declaration order"
+                      << std::endl;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                if (!placed[i]) {
+                    order.push_back(i);
+                }
+            }
+            break;
+        }
+
+        placed[next] = 1;
+        order.push_back(next);
+        for (auto [from, to] : edges) {
+            if (from == next) {
+                incoming[to]--;
+            }
+        }
+    }
+}
+
+static bool transient(flecs::world &world, flecs::entity_t resource) {
+    return world.entity(resource).has<TransientTexture>();
+}
+
+// Keep passes that write a resource owned outside the graph and every pass they depend on
+static void cull_nodes(flecs::world &world, RenderGraph &graph) {
+    auto &nodes = graph.nodes;
+    for (auto it = graph.order.rbegin(); it != graph.order.rend(); it++) {
+        GraphNode &node = nodes[*it];
+        for (uint32_t r = node.writes_begin; r < node.writes_end; r++) {
+            if (!transient(world, graph.resources[r])) {
+                node.live = true;
+            }
+        }
+        if (!node.live) {
+            continue;
+        }
+        for (auto [from, to] : graph.edges) {
+            if (to == *it) {
+                nodes[from].live = true;
+            }
+        }
+    }
+}
+
+// Uses of every transient texture by live passes, pushed in order of first use
+static void collect_transients(flecs::world &world, RenderGraph &graph) {
+    auto &transients = graph.transients;
+    transients.clear();
+    for (size_t position = 0; position < graph.order.size(); position++) {
+        const GraphNode &node = graph.nodes[graph.order[position]];
+        if (!node.live) {
+            continue;
+        }
+        for (uint32_t r = node.reads_begin; r < node.writes_end; r++) {
+            flecs::entity_t resource = graph.resources[r];
+            if (!transient(world, resource)) {
+                continue;
+            }
+            auto use = std::find_if(
+                transients.begin(), transients.end(),
+                [&](const TransientUse &other) { return other.resource == resource; });
+            if (use == transients.end()) {
+                transients.push_back({resource, (int32_t)position, (int32_t)position, SIZE_MAX});
+            } else {
+                use->last = (int32_t)position;
+            }
+        }
+    }
+}
+
+static bool same_texture(const RenderTarget &target, const TransientTexture &texture,
+                         uint32_t width, uint32_t height) {
+    return target.format == texture.format &&
+           (wgpu::TextureUsage::W)target.usage == (wgpu::TextureUsage::W)texture.usage &&
+           target.sample_count == texture.sample_count && target.width == width &&
+           target.height == height;
+}
+
+// Assign transient textures to physical textures in order of first use, a texture is reused once
+// the last pass of its previous transient ran. Runs every frame since the window size can change.
+static void allocate_textures(flecs::world &world, RenderGraph &graph, GraphStats &stats) {
+    WGPU &webgpu = world.get_mut<WGPU>();
+    const Window &window = world.get<Window>();
+    for (auto &texture : graph.textures) {
+        texture.busy_until = -1;
+    }
+
+    for (TransientUse &use : graph.transients) {
+        use.texture = SIZE_MAX;
+        const TransientTexture *desc = world.entity(use.resource).try_get<TransientTexture>();
+        if (desc == nullptr) {
+            continue;
+        }
+        uint32_t downscale = std::max(desc->downscale, 1u);
+        uint32_t width = desc->width;
+        uint32_t height = desc->height;
+        if (width == 0 || height == 0) {
+            width = std::max((uint32_t)window.width / downscale, 1u);
+            height = std::max((uint32_t)window.height / downscale, 1u);
+        }
+
+        size_t index = SIZE_MAX;
+        for (size_t i = 0; i < graph.textures.size(); i++) {
+            PhysicalTexture &texture = graph.textures[i];
+            if (texture.busy_until < use.first &&
+                same_texture(texture.target, *desc, width, height)) {
+                index = i;
+                break;
+            }
+        }
+        if (index == SIZE_MAX) {
+            PhysicalTexture texture;
+            texture.target.format = desc->format;
+            texture.target.usage = desc->usage;
+            texture.target.sample_count = desc->sample_count;
+            texture.target.resize(webgpu, width, height);
+            index = graph.textures.size();
+            graph.textures.push_back(texture);
+        }
+
+        graph.textures[index].busy_until = use.last;
+        use.texture = index;
+    }
+
+    for (size_t i = 0; i < graph.textures.size();) {
+        PhysicalTexture &texture = graph.textures[i];
+        texture.idle_frames = texture.busy_until < 0 ? texture.idle_frames + 1 : 0;
+        if (texture.idle_frames > RenderGraph::max_idle_frames) {
+            texture.target.release();
+            graph.textures.erase(graph.textures.begin() + i);
+            // Indices of later textures shifted, nothing idle is assigned this frame
+            for (TransientUse &use : graph.transients) {
+                use.texture -= use.texture != SIZE_MAX && use.texture > i ? 1 : 0;
+            }
+        } else {
+            i++;
+        }
+    }
+
+    stats.transient_textures = (uint32_t)graph.transients.size();
+    stats.allocated_textures = (uint32_t)graph.textures.size();
+}
+
+wgpu::TextureView graph_texture(flecs::world &world, flecs::entity_t resource) {
+    const RenderGraph &graph = world.get<RenderGraph>();
+    for (const TransientUse &use : graph.transients) {
+        if (use.resource == resource) {
+            return use.texture != SIZE_MAX ? graph.textures[use.texture].target.view : nullptr;
+        }
+    }
+    for (auto &[imported, view] : graph.imported) {
+        if (imported == resource) {
+            return view;
+        }
+    }
+    if (const ImportedTexture *texture = world.entity(resource).try_get<ImportedTexture>()) {
+        return texture->view;
+    }
+    return nullptr;
+}
+
+static bool same_attachment(const Attachment &a, const Attachment &b) {
+    return a.resource == b.resource && a.resolve == b.resolve;
+}
+
+// Whether a render pass can continue the render pass of the pass before it
+static bool can_merge(const RenderGraph &graph, const GraphNode &previous, const GraphPass &a,
+                      const GraphNode &node, const GraphPass &b) {
+    if (a.kind != PassKind::Render || b.kind != PassKind::Render ||
+        a.colors.size() != b.colors.size() || !same_attachment(a.depth, b.depth)) {
+        return false;
+    }
+    for (size_t i = 0; i < a.colors.size(); i++) {
+        if (!same_attachment(a.colors[i], b.colors[i]) || b.colors[i].load != wgpu::LoadOp::Load) {
+            return false;
+        }
+    }
+    if (b.depth.resource != 0 && b.depth.load != wgpu::LoadOp::Load) {
+        return false;
+    }
+    // Sampling an attachment of the same render pass isn't allowed
+    for (uint32_t r = node.reads_begin; r < node.reads_end; r++) {
+        if (writes(graph, previous, graph.resources[r])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Load operations of the first pass, store operations of the last
+static wgpu::RenderPassEncoder begin_render_pass(flecs::world &world, wgpu::CommandEncoder encoder,
+                                                 const GraphPass &first, const GraphPass &last) {
+    std::array<wgpu::RenderPassColorAttachment, GraphPass::max_colors> colors;
+    size_t color_count = 0;
+    for (size_t i = 0; i < first.colors.size(); i++) {
+        const Attachment &attachment = first.colors[i];
+        wgpu::TextureView view = graph_texture(world, attachment.resource);
+        if (view == nullptr) {
+            continue;
+        }
+        if (color_count == colors.size()) {
+            std::cerr << "Render pass has more than " << colors.size()
+                      << " color attachments, the rest are left out" << std::endl;
+            break;
+        }
+        wgpu::RenderPassColorAttachment &color = colors[color_count++];
+        color.view = view;
+        color.resolveTarget =
+            attachment.resolve != 0 ? graph_texture(world, attachment.resolve) : nullptr;
+        color.loadOp = attachment.load;
+        color.storeOp = last.colors[i].store;
+        color.clearValue = attachment.clear;
+    }
+
+    wgpu::RenderPassDescriptor render_pass_desc;
+    render_pass_desc.colorAttachmentCount = color_count;
+    render_pass_desc.colorAttachments = colors.data();
+
+    wgpu::RenderPassDepthStencilAttachment depth_attachment;
+    render_pass_desc.depthStencilAttachment = nullptr;
+    wgpu::TextureView depth_view =
+        first.depth.resource != 0 ? graph_texture(world, first.depth.resource) : nullptr;
+    if (depth_view != nullptr) {
+        depth_attachment.view = depth_view;
+        depth_attachment.depthClearValue = first.depth.depth_clear;
+        depth_attachment.depthLoadOp = first.depth.load;
+        depth_attachment.depthStoreOp = last.depth.store;
+        depth_attachment.depthReadOnly = false;
+        // Depth24Plus has no stencil aspect
+        depth_attachment.stencilClearValue = 0;
+        depth_attachment.stencilLoadOp = wgpu::LoadOp::Undefined;
+        depth_attachment.stencilStoreOp = wgpu::StoreOp::Undefined;
+        depth_attachment.stencilReadOnly = true;
+        render_pass_desc.depthStencilAttachment = &depth_attachment;
+    }
+    render_pass_desc.timestampWrites = nullptr;
+    return encoder.beginRenderPass(render_pass_desc);
+}
+
+// Record the grouped passes into one render or compute pass. Passes are looked up by entity, no
+// pointer into a component column is kept while passes execute.
+static void record_group(flecs::world &world, RenderGraph &graph, wgpu::CommandEncoder encoder,
+                         GraphStats &stats) {
+    if (graph.group.empty()) {
+        return;
+    }
+    const GraphPass &first = world.entity(graph.nodes[graph.group.front()].entity).get<GraphPass>();
+    PassContext context{world, encoder};
+    if (first.kind == PassKind::Render) {
+        const GraphPass &last =
+            world.entity(graph.nodes[graph.group.back()].entity).get<GraphPass>();
+        context.render = begin_render_pass(world, encoder, first, last);
+        stats.render_passes++;
+    } else {
+        wgpu::ComputePassDescriptor compute_pass_desc;
+        compute_pass_desc.timestampWrites = nullptr;
+        context.compute = encoder.beginComputePass(compute_pass_desc);
+        stats.compute_passes++;
+    }
+
+    for (size_t index : graph.group) {
+        context.pass = world.entity(graph.nodes[index].entity);
+        auto execute = context.pass.get<GraphPass>().execute;
+        if (execute != nullptr) {
+            execute(context);
+        }
+    }
+
+    if (context.render != nullptr) {
+        context.render.end();
+        context.render.release();
+    }
+    if (context.compute != nullptr) {
+        context.compute.end();
+        context.compute.release();
+    }
+    graph.group.clear();
+}
+
+void execute_graph(flecs::world &world, wgpu::CommandEncoder encoder, const GraphImports &imports) {
+    RenderGraph &graph = world.get_mut<RenderGraph>();
+    GraphStats &stats = world.get_mut<GraphStats>();
+    stats.render_passes = 0;
+    stats.compute_passes = 0;
+    stats.culled = 0;
+    stats.merged = 0;
+
+    graph.imported.assign(imports.begin(), imports.end());
+
+    // A changed pipeline can bind different resources, which changes what the main pass reads
+    if (!graph.compiled || graph.passes.changed() || graph.render_functions.changed()) {
+        collect_nodes(graph);
+        sort_nodes(graph);
+        cull_nodes(world, graph);
+        collect_transients(world, graph);
+        graph.compiled = true;
+        stats.compiles++;
+    }
+    allocate_textures(world, graph, stats);
+
+    graph.group.clear();
+    for (size_t index : graph.order) {
+        const GraphNode &node = graph.nodes[index];
+        const GraphPass *pass = world.entity(node.entity).try_get<GraphPass>();
+        if (pass == nullptr) {
+            continue;
+        }
+        if (!node.live) {
+            stats.culled++;
+            continue;
+        }
+
+        bool merge = false;
+        if (!graph.group.empty()) {
+            const GraphNode &previous = graph.nodes[graph.group.back()];
+            const GraphPass &previous_pass = world.entity(previous.entity).get<GraphPass>();
+            // Dispatches are ordered within a compute pass, any two compute passes can share one
+            bool compute =
+                previous_pass.kind == PassKind::Compute && pass->kind == PassKind::Compute;
+            merge = compute || can_merge(graph, previous, previous_pass, node, *pass);
+        }
+        if (!merge) {
+            record_group(world, graph, encoder, stats);
+        } else if (pass->kind == PassKind::Render) {
+            stats.merged++;
+        }
+        graph.group.push_back(index);
+    }
+    record_group(world, graph, encoder, stats);
+}
+
+} // namespace rendering
+
+namespace render_graph {
+
+using namespace rendering;
+
+module::module(flecs::world &world) {
+    world.component<RenderGraph>().on_remove(&RenderGraph::on_remove);
+    world.component<GraphPass>();
+    world.component<TransientTexture>();
+    world.component<ImportedTexture>();
+    world.component<GraphStats>()
+        .member<uint32_t>("render_passes")
+        .member<uint32_t>("compute_passes")
+        .member<uint32_t>("culled")
+        .member<uint32_t>("merged")
+        .member<uint32_t>("transient_textures")
+        .member<uint32_t>("allocated_textures")
+        .member<uint32_t>("compiles");
+    world.set<GraphStats>({});
+
+    RenderGraph graph;
+    graph.passes = world.query_builder<const GraphPass>().cached().detect_changes().build();
+    graph.render_functions =
+        world.query_builder<const RenderFunction>().cached().detect_changes().build();
+    world.set<RenderGraph>(std::move(graph));
+}
+
+} // namespace render_graph
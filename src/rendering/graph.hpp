@@ -0,0 +1,120 @@
+#pragma once
+
+#include "flecs.h"
+#include "arena.hpp"
+#include "rendering.hpp"
+#include <utility>
+#include <vector>
+
+namespace rendering {
+
+enum class PassKind : uint8_t {
+    Render,  // Draws into its attachments inside a render pass
+    Compute, // Dispatches inside a compute pass
+};
+
+// Texture a render pass draws into. Attachments whose resource has no view this frame are left out
+// of the pass, so optional targets can be declared unconditionally.
+struct Attachment {
+    flecs::entity_t resource = 0;
+    // Multisampled attachments are resolved into this resource at the end of the pass
+    flecs::entity_t resolve = 0;
+    wgpu::LoadOp load = wgpu::LoadOp::Clear;
+    wgpu::StoreOp store = wgpu::StoreOp::Store;
+    wgpu::Color clear = {0.0, 0.0, 0.0, 0.0};
+    // Depth attachments only
+    float depth_clear = 1.0f;
+};
+
+// Encoders a pass records with, render or compute is set to match the kind of the pass. Merged
+// passes share the encoders, pass is the entity whose GraphPass is executing.
+struct PassContext {
+    flecs::world world;
+    wgpu::CommandEncoder encoder = nullptr;
+    wgpu::RenderPassEncoder render = nullptr;
+    wgpu::ComputePassEncoder compute = nullptr;
+    flecs::entity pass;
+};
+
+// Node of the render graph. Resources are entities, writers of a resource run before its readers
+// and attachments count as writes, so passes are ordered from their declarations alone. Passes
+// whose writes are all transient textures nobody reads are skipped. Consecutive render passes with
+// the same attachments that load instead of clear are recorded into a single render pass, and
+// consecutive compute passes share one compute pass. The order is only compiled again when a
+// GraphPass or the RenderFunction pipelines change.
+struct GraphPass {
+    // Color attachments a render pass can have
+    static constexpr size_t max_colors = 8;
+
+    PassKind kind = PassKind::Render;
+    std::vector<flecs::entity_t> reads;
+    std::vector<flecs::entity_t> writes;
+    std::vector<Attachment> colors;
+    // No depth attachment while the resource is 0
+    Attachment depth;
+    // Also reads every resource the RenderFunction pipelines bind, for passes that draw them
+    bool draws_render_functions = false;
+    // Breaks ties between passes without a dependency, lower first, then in declaration order
+    int32_t order = 0;
+    // Plain function like RenderFunction, state lives in components of the pass entity
+    void (*execute)(PassContext &context) = nullptr;
+};
+
+// Texture allocated by the graph for the frames it's used in. Transient textures with the same
+// description whose first and last use don't overlap share one texture. Add it to a resource
+// before passes use it, changing which resources are transient doesn't recompile the graph.
+struct TransientTexture {
+    wgpu::TextureFormat format = wgpu::TextureFormat::BGRA8Unorm;
+    // Cast required for emscripten
+    wgpu::TextureUsage usage = (wgpu::TextureUsage::W)(wgpu::TextureUsage::RenderAttachment |
+                                                        wgpu::TextureUsage::TextureBinding);
+    uint32_t sample_count = 1;
+    // Window sized divided by downscale when zero
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t downscale = 1;
+};
+
+// Texture owned outside the graph whose view stays valid across frames
+struct ImportedTexture {
+    wgpu::TextureView view = nullptr;
+};
+
+// Swapchain texture of the current frame
+struct SurfaceTarget {};
+
+// Transient texture the main pass draws into instead of the surface while post-processing is on
+struct SceneColor {};
+
+// Passes recorded in the last frame and how often the order was compiled since startup
+struct GraphStats {
+    uint32_t render_passes;
+    uint32_t compute_passes;
+    uint32_t culled;
+    // Render passes recorded into the render pass of the pass before them
+    uint32_t merged;
+    uint32_t transient_textures;
+    // Textures backing the transient textures after aliasing
+    uint32_t allocated_textures;
+    uint32_t compiles;
+};
+
+// Views of resources owned outside the graph that change every frame, like the surface
+using GraphImports = FrameVector<std::pair<flecs::entity_t, wgpu::TextureView>>;
+
+// Texture view a resource resolves to while the graph executes, nullptr if it has none
+wgpu::TextureView graph_texture(flecs::world &world, flecs::entity_t resource);
+
+// Order and cull the declared passes if they changed, allocate their transient textures, then
+// record them into the encoder
+void execute_graph(flecs::world &world, wgpu::CommandEncoder encoder, const GraphImports &imports);
+
+} // namespace rendering
+
+namespace render_graph {
+
+struct module {
+    module(flecs::world &world);
+};
+
+} // namespace render_graph
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+namespace rendering {
+
+// One segment of the line instance buffer, matches the Line struct in line.wgsl
+struct LineData {
+    // Start and end point in world units
+    std::array<float, 4> points;
+    std::array<float, 4> color;
+    // Width in pixels, zero length segments are drawn as squares of this size
+    float width;
+    float padding[3];
+};
+
+static_assert(sizeof(LineData) == 12 * sizeof(float), "LineData must be three vec4 rows");
+
+// Lines and points drawn over everything else for a single frame. Anything may add to it until
+// RenderSystems::Prepare, where the line pipeline uploads and clears it.
+struct DebugLines {
+    std::vector<LineData> lines;
+
+    void line(float x0, float y0, float x1, float y1, const std::array<float, 4> &color,
+              float width = 1.0f) {
+        lines.push_back({{x0, y0, x1, y1}, color, width, {}});
+    }
+
+    void point(float x, float y, const std::array<float, 4> &color, float size = 4.0f) {
+        lines.push_back({{x, y, x, y}, color, size, {}});
+    }
+};
+
+} // namespace rendering
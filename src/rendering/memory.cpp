@@ -0,0 +1,132 @@
+#include "memory.hpp"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace rendering {
+
+// Every category followed by the total
+constexpr size_t total_index = gpu_memory_category_count;
+
+struct Allocation {
+    GpuMemoryCategory category;
+    uint64_t bytes;
+};
+
+// Resources may be created from worker threads, all state is guarded by the mutex
+struct GpuMemoryTracker {
+    std::mutex mutex;
+    std::unordered_map<const void *, Allocation> allocations;
+    GpuMemoryUsage usage[gpu_memory_category_count + 1] = {};
+
+    void add(const void *handle, GpuMemoryCategory category, uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        allocations[handle] = {category, bytes};
+        for (size_t index : {(size_t)category, total_index}) {
+            usage[index].bytes += bytes;
+            usage[index].peak = std::max(usage[index].peak, usage[index].bytes);
+        }
+    }
+
+    void remove(const void *handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = allocations.find(handle);
+        if (it == allocations.end()) {
+            return;
+        }
+        for (size_t index : {(size_t)it->second.category, total_index}) {
+            usage[index].bytes -= it->second.bytes;
+        }
+        allocations.erase(it);
+    }
+};
+
+static GpuMemoryTracker tracker;
+
+static GpuMemoryCategory buffer_category(uint64_t usage) {
+    if (usage & (WGPUBufferUsage_Vertex | WGPUBufferUsage_Index)) {
+        return GpuMemoryCategory::Vertices;
+    }
+    if (usage & WGPUBufferUsage_Uniform) {
+        return GpuMemoryCategory::Uniforms;
+    }
+    if (usage & (WGPUBufferUsage_MapRead | WGPUBufferUsage_MapWrite)) {
+        return GpuMemoryCategory::Staging;
+    }
+    return GpuMemoryCategory::Instances;
+}
+
+static uint64_t texel_size(WGPUTextureFormat format) {
+    switch (format) {
+    case WGPUTextureFormat_R8Unorm:
+    case WGPUTextureFormat_R8Uint:
+        return 1;
+    case WGPUTextureFormat_RG8Unorm:
+    case WGPUTextureFormat_R16Float:
+    case WGPUTextureFormat_Depth16Unorm:
+        return 2;
+    case WGPUTextureFormat_RG32Float:
+    case WGPUTextureFormat_RGBA16Float:
+        return 8;
+    case WGPUTextureFormat_RGBA32Float:
+        return 16;
+    default:
+        // 8 bit RGBA and BGRA, 16 bit RG, 32 bit single channel and depth formats
+        return 4;
+    }
+}
+
+wgpu::Buffer create_buffer(wgpu::Device device, const wgpu::BufferDescriptor &desc) {
+    wgpu::Buffer buffer = device.createBuffer(desc);
+    if (buffer != nullptr) {
+        uint64_t usage = (uint64_t)(wgpu::BufferUsage::W)desc.usage;
+        tracker.add((WGPUBuffer)buffer, buffer_category(usage), desc.size);
+    }
+    return buffer;
+}
+
+wgpu::Texture create_texture(wgpu::Device device, const wgpu::TextureDescriptor &desc) {
+    wgpu::Texture texture = device.createTexture(desc);
+    if (texture != nullptr) {
+        uint64_t texels = 0;
+        for (uint32_t level = 0; level < std::max(desc.mipLevelCount, 1u); level++) {
+            texels += (uint64_t)std::max(desc.size.width >> level, 1u) *
+                      std::max(desc.size.height >> level, 1u);
+        }
+        uint64_t bytes = texels * std::max(desc.size.depthOrArrayLayers, 1u) *
+                         std::max(desc.sampleCount, 1u) *
+                         texel_size((WGPUTextureFormat)desc.format);
+        tracker.add((WGPUTexture)texture, GpuMemoryCategory::Textures, bytes);
+    }
+    return texture;
+}
+
+void destroy_buffer(wgpu::Buffer &buffer) {
+    if (buffer == nullptr) {
+        return;
+    }
+    tracker.remove((WGPUBuffer)buffer);
+    buffer.destroy();
+    buffer.release();
+    buffer = nullptr;
+}
+
+void destroy_texture(wgpu::Texture &texture) {
+    if (texture == nullptr) {
+        return;
+    }
+    tracker.remove((WGPUTexture)texture);
+    texture.destroy();
+    texture.release();
+    texture = nullptr;
+}
+
+GpuMemoryStats gpu_memory_stats() {
+    std::lock_guard<std::mutex> lock(tracker.mutex);
+    auto &usage = tracker.usage;
+    return {usage[(size_t)GpuMemoryCategory::Instances], usage[(size_t)GpuMemoryCategory::Vertices],
+            usage[(size_t)GpuMemoryCategory::Uniforms],  usage[(size_t)GpuMemoryCategory::Textures],
+            usage[(size_t)GpuMemoryCategory::Staging],   usage[total_index]};
+}
+
+} // namespace rendering
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "webgpu/webgpu.hpp"
+
+namespace rendering {
+
+// Buffers are sorted by their usage: vertex and index buffers are vertices, uniform buffers are
+// uniforms, mappable buffers are staging and every other buffer holds instances
+enum class GpuMemoryCategory : uint8_t {
+    Instances,
+    Vertices,
+    Uniforms,
+    Textures,
+    Staging,
+};
+constexpr size_t gpu_memory_category_count = 5;
+
+// Bytes a category holds now and the most it held since startup
+struct GpuMemoryUsage {
+    uint64_t bytes;
+    uint64_t peak;
+};
+
+// Copied from the tracker during Load, so it lags the resources created later in the frame
+struct GpuMemoryStats {
+    GpuMemoryUsage instances;
+    GpuMemoryUsage vertices;
+    GpuMemoryUsage uniforms;
+    GpuMemoryUsage textures;
+    GpuMemoryUsage staging;
+    GpuMemoryUsage total;
+};
+
+// Warns once the total crosses the budget, no budget while zero
+struct GpuMemoryBudget {
+    uint64_t bytes = 0;
+};
+
+// Create and destroy GPU resources through these so the allocation is counted. The tracker is
+// shared by every world, there is only ever one device. Sizes of textures are estimated from the
+// texel size of their format, drivers may pad them.
+wgpu::Buffer create_buffer(wgpu::Device device, const wgpu::BufferDescriptor &desc);
+wgpu::Texture create_texture(wgpu::Device device, const wgpu::TextureDescriptor &desc);
+
+// Destroy and release the resource and reset the handle, nothing happens for null handles
+void destroy_buffer(wgpu::Buffer &buffer);
+void destroy_texture(wgpu::Texture &texture);
+
+// Usage of every category right now
+GpuMemoryStats gpu_memory_stats();
+
+} // namespace rendering
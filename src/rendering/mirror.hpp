@@ -0,0 +1,173 @@
+#pragma once
+
+#include "flecs.h"
+#include "rendering.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace rendering {
+
+// Converts a column of components to their GPU layout. Specialize for components whose layout
+// differs from their GPU representation, components mirrored as themselves are copied with memcpy.
+template <typename Component, typename GpuLayout> struct GpuPack {
+    static void pack(const Component *src, GpuLayout *dst, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = GpuLayout(src[i]);
+        }
+    }
+};
+
+// Storage buffer kept in sync with every Component in the world, elements are in table order.
+// Tables that didn't change since the last sync are skipped and only the range that changed is
+// uploaded. Change detection relies on flecs dirty state, so writes through pointers outside of
+// systems must call modified().
+template <typename Component, typename GpuLayout = Component> struct GpuMirror {
+    static_assert(std::is_trivially_copyable_v<GpuLayout>, "GPU layout must be trivially copyable");
+
+    // Range of the buffer a table was packed into during the last sync
+    struct TableRange {
+        const flecs::table_t *table;
+        size_t offset;
+        size_t count;
+    };
+
+    flecs::query<const Component> query;
+    std::vector<GpuLayout> data;
+    std::vector<TableRange> tables;
+    // Set while work that indexes the buffer wasn't recorded yet, syncing waits until it's cleared
+    bool hold = false;
+
+    // Offset of a table's elements as of the last sync, SIZE_MAX for tables that weren't synced
+    size_t table_offset(const flecs::table_t *table) const {
+        for (const TableRange &range : tables) {
+            if (range.table == table) {
+                return range.offset;
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    // Repack changed tables, returns the element range that needs uploading
+    std::pair<size_t, size_t> sync() {
+        size_t dirty_begin = SIZE_MAX;
+        size_t dirty_end = 0;
+        if (!query.changed()) {
+            return {0, 0};
+        }
+
+        size_t offset = 0;
+        size_t index = 0;
+        query.run([&](flecs::iter &it) {
+            while (it.next()) {
+                const flecs::table_t *table = it.c_ptr()->table;
+                size_t count = it.count();
+
+                // Earlier tables changing size shift everything after them
+                bool moved = index >= tables.size() || tables[index].table != table ||
+                             tables[index].offset != offset || tables[index].count != count;
+                if (moved) {
+                    tables.resize(index + 1);
+                    tables[index] = {table, offset, count};
+                }
+
+                if (moved || it.changed()) {
+                    if (data.size() < offset + count) {
+                        data.resize(offset + count);
+                    }
+                    const Component *src = &it.field<const Component>(0)[0];
+                    if constexpr (std::is_same_v<Component, GpuLayout>) {
+                        std::memcpy(data.data() + offset, src, count * sizeof(GpuLayout));
+                    } else {
+                        GpuPack<Component, GpuLayout>::pack(src, data.data() + offset, count);
+                    }
+                    dirty_begin = std::min(dirty_begin, offset);
+                    dirty_end = offset + count;
+                }
+
+                offset += count;
+                index++;
+            }
+        });
+
+        tables.resize(index);
+        if (data.size() != offset) {
+            data.resize(offset);
+            dirty_begin = std::min(dirty_begin, offset);
+            dirty_end = offset;
+        }
+        return {std::min(dirty_begin, dirty_end), dirty_end};
+    }
+
+    // Upload the dirty range, the whole buffer is rewritten and rebound when the count changed
+    void upload(WGPU &webgpu, Buffer &buffer, Binding &binding, BindingLayout &layout,
+                std::pair<size_t, size_t> dirty) {
+        if (buffer.buffer == nullptr || buffer.count != data.size()) {
+            buffer.write_buffer(webgpu, data);
+            if (data.size() > 0) {
+                buffer.update_bind_group(webgpu, binding, layout);
+            }
+        } else if (dirty.second > dirty.first) {
+            webgpu.queue.writeBuffer(buffer.buffer, dirty.first * sizeof(GpuLayout),
+                                     data.data() + dirty.first,
+                                     (dirty.second - dirty.first) * sizeof(GpuLayout));
+        }
+    }
+};
+
+inline wgpu::BindGroupLayout init_storage_layout(WGPU &webgpu, wgpu::ShaderStage visibility,
+                                                 std::string_view label) {
+    wgpu::BindGroupLayoutEntry entry;
+    entry.binding = 0;
+    entry.buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+    entry.visibility = visibility;
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc;
+    bind_group_layout_desc.entryCount = 1;
+    bind_group_layout_desc.entries = &entry;
+    bind_group_layout_desc.label = toWgpuStringView(label);
+
+    return webgpu.device.createBindGroupLayout(bind_group_layout_desc);
+}
+
+// Mirror every Component into a storage buffer synced in RenderSystems::Prepare. Pipelines bind
+// it like any other buffer entity with .set<Binds, GpuMirror<Component, GpuLayout>>({index}), the
+// bind group only exists once there is at least one component.
+template <typename Component, typename GpuLayout = Component>
+flecs::entity mirror(flecs::world &world,
+                     wgpu::ShaderStage visibility = wgpu::ShaderStage::Vertex) {
+    using Mirror = GpuMirror<Component, GpuLayout>;
+    WGPU &webgpu = world.ensure<WGPU>();
+
+    auto query =
+        world.query_builder<const Component>().term_at(0).self().cached().detect_changes().build();
+
+    auto layout = init_storage_layout(webgpu, visibility, "Mirror Bind Group Layout");
+    auto entity =
+        world.singleton<Mirror>()
+            // Cast required for emscripten
+            .set<Buffer>(
+                {(wgpu::BufferUsage::W)(wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst)})
+            .set<BindingLayout>({layout})
+            .add<Binding>()
+            .set<Mirror>({query});
+
+    world.system<WGPU, Mirror, Buffer, Binding, BindingLayout>()
+        .term_at(0)
+        .singleton()
+        .kind<RenderSystems::Prepare>()
+        .each([](WGPU &webgpu, Mirror &mirror, Buffer &buffer, Binding &binding,
+                 BindingLayout &layout) {
+            if (mirror.hold) {
+                return;
+            }
+            auto dirty = mirror.sync();
+            mirror.upload(webgpu, buffer, binding, layout, dirty);
+        });
+
+    return entity;
+}
+
+} // namespace rendering
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace rendering {
+
+// Emits particles from the entity Position, the rotation turns the emission direction. Particles
+// are spawned, moved and killed in a compute shader and drawn with the quad shader as circles, the
+// CPU only uploads the emitters. An optional Layer sets the draw order like for other shapes.
+// Emitter settings are mirrored to the GPU when they change, so change them with set() or call
+// modified() after writing through a pointer.
+struct ParticleEmitter {
+    // Particles per second, and particles emitted once on the frame after the emitter is set
+    float rate = 0.0f;
+    uint32_t burst = 0;
+    // Delete the entity once its burst went out, for effects that are fired and forgotten
+    bool one_shot = false;
+
+    // Angle of the emission cone and half its opening angle, in radians
+    float direction = 0.0f;
+    float spread = 3.14159265f;
+    // Picked uniformly within value +- variance for every particle
+    float speed = 100.0f;
+    float speed_variance = 0.0f;
+    float lifetime = 1.0f;
+    float lifetime_variance = 0.0f;
+    // Diameter and color are interpolated over the lifetime of a particle
+    float size_start = 4.0f;
+    float size_end = 0.0f;
+    std::array<float, 4> color_start = {1.0f, 1.0f, 1.0f, 1.0f};
+    std::array<float, 4> color_end = {1.0f, 1.0f, 1.0f, 0.0f};
+    // Vertical acceleration, and the fraction of the velocity lost per second
+    float gravity = 0.0f;
+    float drag = 0.0f;
+};
+
+// Particles that can be alive at once, emitting into a full buffer drops the new particles. The
+// buffers are allocated once the first emitter exists and take about 130 bytes per particle.
+// Changing the capacity afterwards reallocates them and clears every particle.
+struct ParticleSettings {
+    static constexpr uint32_t max_capacity = 1u << 21;
+
+    uint32_t capacity = 1u << 18;
+};
+
+// Counters for the inspector, live particles stay on the GPU and aren't counted
+struct ParticleStats {
+    uint32_t emitters;
+    uint32_t emitted;
+    uint32_t capacity;
+};
+
+} // namespace rendering
@@ -0,0 +1,111 @@
+#include "../lines.hpp"
+#include "../mirror.hpp"
+#include "flecs.h"
+#include "pipelines.hpp"
+#include <algorithm>
+#include <cstdint>
+
+using namespace rendering;
+
+namespace line_pipeline {
+
+struct LinePipeline {};
+
+struct LineInstanceBuffer {};
+
+// Lines uploaded in the last Prepare. The Buffer count holds the capacity instead, the buffer
+// only grows so its bind group survives the line count changing every frame.
+struct LineCount {
+    uint32_t count = 0;
+};
+
+module::module(flecs::world &world) {
+    WGPU &webgpu = world.ensure<WGPU>();
+    auto instance_layout =
+        init_storage_layout(webgpu, wgpu::ShaderStage::Vertex, "Line Instance Bind Group Layout");
+    auto &uniform_layout = world.entity<Uniforms>().get<BindingLayout>().layout.value();
+
+    world.set<DebugLines>({});
+
+    world.singleton<LineInstanceBuffer>()
+        .add<LineInstanceBuffer>()
+        // Cast required for emscripten
+        .set<Buffer>(
+            {(wgpu::BufferUsage::W)(wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst)})
+        .set<BindingLayout>({instance_layout})
+        .add<Binding>()
+        .set<LineCount>({});
+
+    // Update buffer
+    world.system<WGPU, DebugLines, Buffer, Binding, BindingLayout, LineCount>()
+        .term_at(0)
+        .singleton()
+        .term_at(1)
+        .singleton()
+        .with<LineInstanceBuffer>()
+        .kind<RenderSystems::Prepare>()
+        .each([](WGPU &webgpu, DebugLines &debug_lines, Buffer &buffer, Binding &binding,
+                 BindingLayout &layout, LineCount &uploaded) {
+            auto &lines = debug_lines.lines;
+            uploaded.count = (uint32_t)lines.size();
+            if (lines.empty()) {
+                return;
+            }
+
+            if (buffer.buffer == nullptr || buffer.count < lines.size()) {
+                size_t capacity = std::max(buffer.count, (size_t)256);
+                while (capacity < lines.size()) {
+                    capacity *= 2;
+                }
+                destroy_buffer(buffer.buffer);
+                buffer.count = capacity;
+                buffer.item_size = sizeof(LineData);
+                buffer.init_buffer(webgpu, capacity * sizeof(LineData));
+                buffer.update_bind_group(webgpu, binding, layout);
+            }
+
+            webgpu.queue.writeBuffer(buffer.buffer, 0, lines.data(),
+                                     lines.size() * sizeof(LineData));
+            lines.clear();
+        });
+
+    // Run pipeline
+    auto render = [](flecs::world &world, wgpu::RenderPassEncoder pass) {
+        uint32_t count = world.entity<LineInstanceBuffer>().get<LineCount>().count;
+        if (count == 0) {
+            return;
+        }
+
+        auto pipeline = world.entity<LinePipeline>();
+        auto render_pipeline = pipeline.get_mut<RenderPipeline>();
+        pass.setPipeline(render_pipeline.pipeline);
+        pipeline.each<Binds>([&](flecs::entity target) {
+            auto binding = pipeline.get<Binds>(target);
+            auto bind_group = target.get<Binding>();
+            pass.setBindGroup((uint32_t)binding.index, bind_group.group, 0, nullptr);
+        });
+        // Every line is a 4 vertex strip expanded from the vertex index
+        pass.draw(4, count, 0, 0);
+    };
+
+    // The pipeline releases its group layouts when removed
+#ifndef EMSCRIPTEN
+    uniform_layout.addRef();
+    instance_layout.addRef();
+#else
+    uniform_layout.reference();
+    instance_layout.reference();
+#endif
+    world.singleton<LinePipeline>()
+        .set<Binds, Uniforms>({0})
+        .set<Binds, LineInstanceBuffer>({1})
+        // Debug lines don't belong to an entity, the shapes under them stay hoverable
+        .add<NotPickable>()
+        .add<Overlay>()
+        .set<Shader>({ASSET_DIR "/shaders/line.wgsl"})
+        .set<RenderPipeline>(
+            {{}, {uniform_layout, instance_layout}, wgpu::PrimitiveTopology::TriangleStrip})
+        .set<RenderFunction>({render});
+}
+
+} // namespace line_pipeline
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "../../common.hpp"
+#include "../simd.hpp"
+#include "flecs.h"
+#include <array>
+
+namespace quad_pipeline {
+
+// One row of the quad instance buffer, matches the Shape struct in quad.wgsl
+struct BufferData {
+    std::array<float, 14> data;
+    // Entity index written to the picking target
+    uint32_t id;
+    uint32_t padding;
+};
+
+static_assert(sizeof(BufferData) == 16 * sizeof(float), "BufferData must be four vec4 rows");
+
+struct ShapeSize {
+    float width;
+    float height;
+    float corner_radius;
+};
+
+inline ShapeSize shape_size(const Quad &quad) {
+    return {quad.width, quad.height, quad.corner_radius};
+}
+
+inline ShapeSize shape_size(const Circle &circle) {
+    return {circle.radius * 2.0f, circle.radius * 2.0f, circle.radius};
+}
+
+// Columns of a table of shapes, layers are optional
+template <typename Shape> struct ShapeColumns {
+    const Shape *shapes;
+    const Position *positions;
+    const Color *colors;
+    const Layer *layers;
+    const flecs::entity_t *entities;
+    size_t count;
+};
+
+// Reference implementation, one field at a time
+template <typename Shape> void pack_scalar(const ShapeColumns<Shape> &columns, BufferData *out) {
+    for (size_t i = 0; i < columns.count; i++) {
+        const Position &pos = columns.positions[i];
+        const Color &color = columns.colors[i];
+        ShapeSize size = shape_size(columns.shapes[i]);
+        float layer = columns.layers != nullptr ? columns.layers[i].value : 0.0f;
+
+        out[i] = {{
+                      color.color[0],
+                      color.color[1],
+                      color.color[2],
+                      color.color[3],
+                      size.corner_radius,
+                      size.corner_radius,
+                      size.corner_radius,
+                      size.corner_radius,
+                      pos.x,
+                      pos.y,
+                      pos.rotation,
+                      layer,
+                      size.width,
+                      size.height,
+                  },
+                  (uint32_t)columns.entities[i],
+                  0};
+    }
+}
+
+// Width and height of a shape in the two low lanes
+inline simd::float4 size_lanes(const Quad &quad) { return simd::float4::load2(&quad.width); }
+inline simd::float4 size_lanes(const Circle &circle) {
+    return simd::float4::broadcast(circle.radius * 2.0f);
+}
+
+// Every row is assembled in registers and written with four vector stores: the color is copied,
+// the corner radius broadcast, and the transform and size rows are combined from two float pairs.
+// Eight shapes are handled per iteration.
+template <typename Shape> void pack_simd(const ShapeColumns<Shape> &columns, BufferData *out) {
+    // Vector stores may alias anything, locals keep the column pointers in registers
+    const Shape *shapes = columns.shapes;
+    const Position *positions = columns.positions;
+    const Color *colors = columns.colors;
+    const Layer *layers = columns.layers;
+    const flecs::entity_t *entities = columns.entities;
+
+    auto pack_one = [=](size_t i) {
+        using simd::float4;
+        const Shape &shape = shapes[i];
+        const Position &pos = positions[i];
+        float layer = layers != nullptr ? layers[i].value : 0.0f;
+        float id = simd::bits_to_float((uint32_t)entities[i]);
+
+        auto *row = (float *)&out[i];
+        float4::load(colors[i].color.data()).store(row);
+        float4::broadcast(shape_size(shape).corner_radius).store(row + 4);
+        float4::combine_low(float4::load2(&pos.x), float4::pair(pos.rotation, layer))
+            .store(row + 8);
+        float4::combine_low(size_lanes(shape), float4::pair(id, 0.0f)).store(row + 12);
+    };
+
+    size_t block_end = columns.count - columns.count % 8;
+    for (size_t i = 0; i < block_end; i += 8) {
+        for (size_t j = 0; j < 8; j++) {
+            pack_one(i + j);
+        }
+    }
+    for (size_t i = block_end; i < columns.count; i++) {
+        pack_one(i);
+    }
+}
+
+template <typename Shape> void pack(const ShapeColumns<Shape> &columns, BufferData *out) {
+#ifdef SIMD_SCALAR
+    pack_scalar(columns, out);
+#else
+    pack_simd(columns, out);
+#endif
+}
+
+} // namespace quad_pipeline
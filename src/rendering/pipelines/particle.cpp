@@ -0,0 +1,566 @@
+#include "../../common.hpp"
+#include "../graph.hpp"
+#include "../mirror.hpp"
+#include "../particles.hpp"
+#include "flecs.h"
+#include "packing.hpp"
+#include "pipelines.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace rendering;
+
+namespace particle_pipeline {
+
+static uint32_t pack_color(const std::array<float, 4> &color) {
+    uint32_t packed = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        float channel = std::clamp(color[i], 0.0f, 1.0f);
+        packed |= (uint32_t)(channel * 255.0f + 0.5f) << (i * 8);
+    }
+    return packed;
+}
+
+// Matches Particle in particles.wgsl
+constexpr uint64_t particle_size = 56;
+
+// Matches EmitterParams in particles.wgsl, mirrored from the ParticleEmitter column
+struct EmitterParams {
+    std::array<float, 2> speed;
+    std::array<float, 2> lifetime;
+    std::array<float, 2> size;
+    float spread;
+    float gravity;
+    float drag;
+    uint32_t color_start;
+    uint32_t color_end;
+    float padding;
+};
+
+static_assert(sizeof(EmitterParams) == 12 * sizeof(float), "EmitterParams must be three vec4 rows");
+
+// Matches Emitter in particles.wgsl, only written for the emitters releasing particles this frame
+struct EmitterData {
+    std::array<float, 2> position;
+    float direction;
+    float layer;
+    // Emit index of the first particle of this emitter, and its index in the mirrored params
+    uint32_t first;
+    uint32_t params;
+};
+
+static_assert(sizeof(EmitterData) == 6 * sizeof(float), "EmitterData must match the WGSL stride");
+
+// Emission progress, kept out of ParticleEmitter so that emitting doesn't dirty the mirror
+struct EmitterState {
+    // Fraction of a particle carried over to the next frame
+    float carry;
+    // Burst of the last set that wasn't emitted yet
+    uint32_t burst;
+};
+
+} // namespace particle_pipeline
+
+namespace rendering {
+
+template <> struct GpuPack<ParticleEmitter, particle_pipeline::EmitterParams> {
+    static void pack(const ParticleEmitter *src, particle_pipeline::EmitterParams *dst,
+                     size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const ParticleEmitter &emitter = src[i];
+            dst[i] = {
+                {emitter.speed - emitter.speed_variance, emitter.speed + emitter.speed_variance},
+                {emitter.lifetime - emitter.lifetime_variance,
+                 emitter.lifetime + emitter.lifetime_variance},
+                {emitter.size_start, emitter.size_end},
+                emitter.spread,
+                emitter.gravity,
+                emitter.drag,
+                particle_pipeline::pack_color(emitter.color_start),
+                particle_pipeline::pack_color(emitter.color_end),
+                0.0f,
+            };
+        }
+    }
+};
+
+} // namespace rendering
+
+namespace particle_pipeline {
+
+using EmitterMirror = GpuMirror<ParticleEmitter, EmitterParams>;
+
+// Matches Params in particles.wgsl
+struct Params {
+    float delta_time;
+    uint32_t capacity;
+    uint32_t emitter_count;
+    uint32_t emit_count;
+    uint32_t seed;
+    uint32_t padding[3];
+};
+
+// Layouts of the compute bind groups: particle state, per frame data and indirect arguments
+struct ParticleLayouts {
+    wgpu::BindGroupLayout state = nullptr;
+    wgpu::BindGroupLayout frame = nullptr;
+    wgpu::BindGroupLayout args = nullptr;
+
+    static void on_remove(ParticleLayouts &value) {
+        value.state.release();
+        value.frame.release();
+        value.args.release();
+    }
+};
+
+// GPU side particle state. The Shape list drawn by the quad shader is the Buffer of the
+// ParticleInstances entity, so the render pipeline binds it like any other buffer.
+struct ParticleBuffers {
+    uint32_t capacity = 0;
+    wgpu::Buffer particles = nullptr;
+    wgpu::Buffer dead = nullptr;
+    wgpu::Buffer alive = nullptr;
+    wgpu::Buffer state = nullptr;
+    wgpu::Buffer args = nullptr;
+    wgpu::BindGroup state_group = nullptr;
+    wgpu::BindGroup args_group = nullptr;
+
+    // Grown by powers of two, the frame group is recreated with it
+    uint32_t emitter_capacity = 0;
+    wgpu::Buffer params = nullptr;
+    wgpu::Buffer emitters = nullptr;
+    wgpu::BindGroup frame_group = nullptr;
+
+    std::vector<EmitterData> emitter_data;
+    // One shot emitters whose burst is in the pending dispatch, deleted once it was recorded
+    std::vector<flecs::entity_t> spent;
+    uint32_t seed = 0;
+    // Set when the buffers were created and every slot still needs to be freed
+    bool reset = false;
+    // Set by Prepare once the frame was uploaded, the graph pass dispatches it
+    bool dispatch = false;
+    uint32_t emit_count = 0;
+
+    static void release_group(wgpu::BindGroup &group) {
+        if (group != nullptr) {
+            group.release();
+            group = nullptr;
+        }
+    }
+
+    void release_state() {
+        release_group(state_group);
+        release_group(args_group);
+        destroy_buffer(particles);
+        destroy_buffer(dead);
+        destroy_buffer(alive);
+        destroy_buffer(state);
+        destroy_buffer(args);
+    }
+
+    void release_frame() {
+        release_group(frame_group);
+        destroy_buffer(params);
+        destroy_buffer(emitters);
+    }
+
+    static void on_remove(ParticleBuffers &value) {
+        value.release_state();
+        value.release_frame();
+    }
+};
+
+struct ParticleInstances {};
+
+struct ParticleReset {};
+struct ParticleSimulate {};
+struct ParticleEmit {};
+struct ParticleFinish {};
+
+struct ParticlePass {};
+
+struct ParticlePipeline {};
+
+static wgpu::Buffer create_buffer(WGPU &webgpu, wgpu::BufferUsage usage, uint64_t size) {
+    wgpu::BufferDescriptor buffer_desc;
+    buffer_desc.usage = usage;
+    buffer_desc.mappedAtCreation = false;
+    buffer_desc.size = size;
+    return rendering::create_buffer(webgpu.device, buffer_desc);
+}
+
+static wgpu::BindGroupLayout init_compute_layout(WGPU &webgpu,
+                                                 const std::vector<wgpu::BufferBindingType> &types,
+                                                 std::string_view label) {
+    std::vector<wgpu::BindGroupLayoutEntry> entries(types.size());
+    for (size_t i = 0; i < types.size(); i++) {
+        entries[i].binding = (uint32_t)i;
+        entries[i].buffer.type = types[i];
+        entries[i].visibility = wgpu::ShaderStage::Compute;
+    }
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc;
+    bind_group_layout_desc.entryCount = entries.size();
+    bind_group_layout_desc.entries = entries.data();
+    bind_group_layout_desc.label = toWgpuStringView(label);
+
+    return webgpu.device.createBindGroupLayout(bind_group_layout_desc);
+}
+
+// Bind every buffer whole, in binding order
+static wgpu::BindGroup init_group(WGPU &webgpu, wgpu::BindGroupLayout layout,
+                                  const std::vector<wgpu::Buffer> &buffers) {
+    std::vector<wgpu::BindGroupEntry> entries(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        wgpu::Buffer buffer = buffers[i];
+        entries[i].binding = (uint32_t)i;
+        entries[i].buffer = buffer;
+        entries[i].offset = 0;
+        entries[i].size = buffer.getSize();
+    }
+
+    wgpu::BindGroupDescriptor descriptor;
+    descriptor.layout = layout;
+    descriptor.entryCount = entries.size();
+    descriptor.entries = entries.data();
+    return webgpu.device.createBindGroup(descriptor);
+}
+
+static void init_state(WGPU &webgpu, const ParticleLayouts &layouts, ParticleBuffers &buffers,
+                       Buffer &instances, Binding &binding, BindingLayout &layout,
+                       uint32_t capacity) {
+    using wgpu::BufferUsage;
+    buffers.release_state();
+    buffers.capacity = capacity;
+
+    // Only ever written by the compute shader
+    buffers.particles = create_buffer(webgpu, BufferUsage::Storage, capacity * particle_size);
+    buffers.dead = create_buffer(webgpu, BufferUsage::Storage, capacity * sizeof(uint32_t));
+    buffers.alive = create_buffer(webgpu, BufferUsage::Storage, 2 * capacity * sizeof(uint32_t));
+    buffers.state = create_buffer(webgpu, BufferUsage::Storage, 4 * sizeof(uint32_t));
+    // Cast required for emscripten
+    buffers.args = create_buffer(
+        webgpu, (BufferUsage::W)(BufferUsage::Storage | BufferUsage::Indirect),
+        8 * sizeof(uint32_t));
+
+    destroy_buffer(instances.buffer);
+    instances.count = capacity;
+    instances.item_size = sizeof(quad_pipeline::BufferData);
+    instances.init_buffer(webgpu, capacity * sizeof(quad_pipeline::BufferData));
+    instances.update_bind_group(webgpu, binding, layout);
+
+    buffers.state_group = init_group(
+        webgpu, layouts.state,
+        {buffers.particles, buffers.dead, buffers.alive, buffers.state, instances.buffer});
+    buffers.args_group = init_group(webgpu, layouts.args, {buffers.args});
+    buffers.reset = true;
+}
+
+static void init_frame(WGPU &webgpu, const ParticleLayouts &layouts, ParticleBuffers &buffers,
+                       uint32_t emitter_count) {
+    using wgpu::BufferUsage;
+    uint32_t capacity = std::max(buffers.emitter_capacity, 16u);
+    while (capacity < emitter_count) {
+        capacity *= 2;
+    }
+    buffers.release_frame();
+    buffers.emitter_capacity = capacity;
+
+    // Cast required for emscripten
+    buffers.params = create_buffer(
+        webgpu, (BufferUsage::W)(BufferUsage::Uniform | BufferUsage::CopyDst), sizeof(Params));
+    buffers.emitters =
+        create_buffer(webgpu, (BufferUsage::W)(BufferUsage::Storage | BufferUsage::CopyDst),
+                      capacity * sizeof(EmitterData));
+    buffers.frame_group = init_group(webgpu, layouts.frame, {buffers.params, buffers.emitters});
+}
+
+// Particles an emitter releases this frame, the fraction left over is carried to the next
+static uint32_t take_emit_count(const ParticleEmitter &emitter, EmitterState &state,
+                                float delta_time) {
+    float pending = state.carry + std::max(emitter.rate, 0.0f) * delta_time;
+    uint32_t count = (uint32_t)pending;
+    state.carry = pending - (float)count;
+    count += state.burst;
+    state.burst = 0;
+    return count;
+}
+
+static bool is_ready(flecs::entity pipeline) {
+    return pipeline.has<Ready>() && pipeline.get<ComputePipeline>().pipeline != nullptr;
+}
+
+static void dispatch_particles(PassContext &context) {
+    flecs::world &world = context.world;
+    auto &buffers = world.entity<ParticleInstances>().get_mut<ParticleBuffers>();
+    if (!buffers.dispatch) {
+        return;
+    }
+    buffers.dispatch = false;
+
+    wgpu::ComputePassEncoder pass = context.compute;
+    pass.setBindGroup(0, buffers.state_group, 0, nullptr);
+    pass.setBindGroup(1, buffers.frame_group, 0, nullptr);
+    pass.setBindGroup(2, buffers.args_group, 0, nullptr);
+
+    if (buffers.reset) {
+        pass.setPipeline(world.entity<ParticleReset>().get<ComputePipeline>().pipeline);
+        pass.dispatchWorkgroups((buffers.capacity + 63) / 64, 1, 1);
+        buffers.reset = false;
+    }
+
+    // Survivors go to the other live list first, new particles are appended after them
+    pass.setPipeline(world.entity<ParticleSimulate>().get<ComputePipeline>().pipeline);
+    pass.dispatchWorkgroupsIndirect(buffers.args, 4 * sizeof(uint32_t));
+    if (buffers.emit_count > 0) {
+        pass.setBindGroup(3, world.entity<EmitterMirror>().get<Binding>().group, 0, nullptr);
+        pass.setPipeline(world.entity<ParticleEmit>().get<ComputePipeline>().pipeline);
+        pass.dispatchWorkgroups((buffers.emit_count + 63) / 64, 1, 1);
+    }
+    pass.setPipeline(world.entity<ParticleFinish>().get<ComputePipeline>().pipeline);
+    pass.dispatchWorkgroups(1, 1, 1);
+
+    for (flecs::entity_t e : buffers.spent) {
+        world.entity(e).destruct();
+    }
+    buffers.spent.clear();
+    // The params the emitters point at were recorded, the mirror may sync again
+    world.entity<EmitterMirror>().get_mut<EmitterMirror>().hold = false;
+}
+
+module::module(flecs::world &world) {
+    WGPU &webgpu = world.ensure<WGPU>();
+    world.component<ParticleLayouts>().on_remove(&ParticleLayouts::on_remove);
+    world.component<ParticleBuffers>().on_remove(&ParticleBuffers::on_remove);
+
+    world.component<ParticleEmitter>();
+    world.component<EmitterState>();
+    world.component<ParticleSettings>().member<uint32_t>("capacity");
+    world.component<ParticleStats>()
+        .member<uint32_t>("emitters")
+        .member<uint32_t>("emitted")
+        .member<uint32_t>("capacity");
+    // Only the default capacity is added here, the buffers are sized when the first emitter exists
+    world.ensure<ParticleSettings>();
+    world.set<ParticleStats>({});
+
+    using wgpu::BufferBindingType;
+    ParticleLayouts layouts;
+    layouts.state = init_compute_layout(webgpu,
+                                        {BufferBindingType::Storage, BufferBindingType::Storage,
+                                         BufferBindingType::Storage, BufferBindingType::Storage,
+                                         BufferBindingType::Storage},
+                                        "Particle State Bind Group Layout");
+    layouts.frame = init_compute_layout(
+        webgpu, {BufferBindingType::Uniform, BufferBindingType::ReadOnlyStorage},
+        "Particle Frame Bind Group Layout");
+    layouts.args = init_compute_layout(webgpu, {BufferBindingType::Storage},
+                                       "Particle Args Bind Group Layout");
+    world.set<ParticleLayouts>(layouts);
+
+    auto instance_layout = init_storage_layout(webgpu, wgpu::ShaderStage::Vertex,
+                                               "Particle Instance Bind Group Layout");
+    auto &uniform_layout = world.entity<Uniforms>().get<BindingLayout>().layout.value();
+
+    world.singleton<ParticleInstances>()
+        .add<ParticleInstances>()
+        // Written by the compute shader and read by the vertex shader, sized with the particles
+        .set<Buffer>({wgpu::BufferUsage::Storage})
+        .set<BindingLayout>({instance_layout})
+        .add<Binding>()
+        .set<ParticleBuffers>({});
+
+    // Every pipeline releases its group layouts when removed, the layouts component keeps its own
+    // reference for creating bind groups
+    auto add_ref = [](wgpu::BindGroupLayout layout) {
+#ifndef EMSCRIPTEN
+        layout.addRef();
+#else
+        layout.reference();
+#endif
+        return layout;
+    };
+    // Emitter settings only reach the GPU when they change, the frame rows index into them. The
+    // mirror syncs before the upload below, both run in Prepare.
+    auto params_layout = mirror<ParticleEmitter, EmitterParams>(world, wgpu::ShaderStage::Compute)
+                             .get<BindingLayout>()
+                             .layout.value();
+
+    // Simulate reads the indirect arguments, they can't be bound for writing in the same dispatch.
+    // Emit reads the mirrored params, which come after the args group it leaves unused.
+    auto compute_pipeline = [&](flecs::entity e, const char *entry_point, bool writes_args,
+                                bool reads_params) {
+        std::vector<wgpu::BindGroupLayout> group_layouts = {add_ref(layouts.state),
+                                                            add_ref(layouts.frame)};
+        if (writes_args || reads_params) {
+            group_layouts.push_back(add_ref(layouts.args));
+        }
+        if (reads_params) {
+            group_layouts.push_back(add_ref(params_layout));
+        }
+        e.set<Shader>({ASSET_DIR "/shaders/particles.wgsl"})
+            .set<ComputePipeline>({group_layouts, nullptr, entry_point});
+    };
+    compute_pipeline(world.singleton<ParticleReset>(), "reset", true, false);
+    compute_pipeline(world.singleton<ParticleSimulate>(), "simulate", false, false);
+    compute_pipeline(world.singleton<ParticleEmit>(), "emit", false, true);
+    compute_pipeline(world.singleton<ParticleFinish>(), "finish", true, false);
+
+    // Setting an emitter restarts its emission and queues its burst
+    world.observer<const ParticleEmitter>()
+        .event(flecs::OnSet)
+        .each([](flecs::entity e, const ParticleEmitter &emitter) {
+            e.set<EmitterState>({0.0f, emitter.burst});
+        });
+
+    auto emitters =
+        world.query_builder<const ParticleEmitter, const Position, const Layer *, EmitterState>()
+            .build();
+
+    // Upload the emitters, the simulation is dispatched by the particle graph pass
+    world
+        .system<WGPU, const ParticleLayouts, const ParticleSettings, ParticleStats,
+                ParticleBuffers, Buffer, Binding, BindingLayout, EmitterMirror>()
+        .term_at(0)
+        .singleton()
+        .term_at(1)
+        .singleton()
+        .term_at(2)
+        .singleton()
+        .term_at(3)
+        .singleton()
+        .term_at(8)
+        .singleton()
+        .with<ParticleInstances>()
+        .kind<RenderSystems::Prepare>()
+        .each([emitters](flecs::iter &it, size_t, WGPU &webgpu, const ParticleLayouts &layouts,
+                         const ParticleSettings &settings, ParticleStats &stats,
+                         ParticleBuffers &buffers, Buffer &instances, Binding &binding,
+                         BindingLayout &layout, EmitterMirror &params) {
+            float delta_time = it.delta_time();
+            stats.emitters = 0;
+            stats.emitted = 0;
+
+            // Emitters keep their particles until they can be dispatched. A dispatch that wasn't
+            // recorded, because the frame had no surface texture, still holds the last upload.
+            flecs::world world = it.world();
+            if (buffers.dispatch || !is_ready(world.entity<ParticleReset>()) ||
+                !is_ready(world.entity<ParticleSimulate>()) ||
+                !is_ready(world.entity<ParticleEmit>()) ||
+                !is_ready(world.entity<ParticleFinish>())) {
+                return;
+            }
+
+            auto &data = buffers.emitter_data;
+            data.clear();
+            uint32_t emit_count = 0;
+            const flecs::table_t *table = nullptr;
+            size_t offset = SIZE_MAX;
+            emitters.each([&](flecs::iter &rows, size_t row, const ParticleEmitter &emitter,
+                              const Position &pos, const Layer *layer, EmitterState &state) {
+                // Emitters created after the mirror synced start on the next frame
+                if (rows.c_ptr()->table != table) {
+                    table = rows.c_ptr()->table;
+                    offset = params.table_offset(table);
+                }
+                stats.emitters++;
+                if (offset == SIZE_MAX) {
+                    return;
+                }
+                flecs::entity e = rows.entity(row);
+                uint32_t count = take_emit_count(emitter, state, delta_time);
+                bool spent = emitter.one_shot && emitter.rate <= 0.0f;
+                if (count == 0) {
+                    if (spent) {
+                        e.destruct();
+                    }
+                    return;
+                }
+                if (spent) {
+                    buffers.spent.push_back(e);
+                }
+
+                data.push_back({
+                    {pos.x, pos.y},
+                    emitter.direction + pos.rotation,
+                    layer != nullptr ? layer->value : 0.0f,
+                    emit_count,
+                    (uint32_t)(offset + row),
+                });
+                emit_count += count;
+            });
+
+            // Nothing is allocated until there is something to emit
+            uint32_t capacity = std::clamp(settings.capacity, 64u, ParticleSettings::max_capacity);
+            if (buffers.capacity == 0 && data.empty()) {
+                return;
+            }
+            if (buffers.capacity != capacity) {
+                init_state(webgpu, layouts, buffers, instances, binding, layout, capacity);
+            }
+            if (buffers.frame_group == nullptr || buffers.emitter_capacity < data.size()) {
+                init_frame(webgpu, layouts, buffers, (uint32_t)data.size());
+            }
+            stats.capacity = capacity;
+
+            // Emitting more than fits would only fail to find free slots
+            emit_count = std::min(emit_count, capacity);
+            stats.emitted = emit_count;
+            Params params{delta_time, capacity, (uint32_t)data.size(), emit_count,
+                          buffers.seed++, {}};
+            webgpu.queue.writeBuffer(buffers.params, 0, &params, sizeof(Params));
+            if (!data.empty()) {
+                webgpu.queue.writeBuffer(buffers.emitters, 0, data.data(),
+                                         data.size() * sizeof(EmitterData));
+            }
+
+            buffers.emit_count = emit_count;
+            buffers.dispatch = true;
+            params.hold = true;
+        });
+
+    // Writes the instances the particle pipeline draws, which orders it before the main pass
+    GraphPass simulate_pass;
+    simulate_pass.kind = PassKind::Compute;
+    simulate_pass.writes = {world.entity<ParticleInstances>()};
+    simulate_pass.execute = dispatch_particles;
+    world.singleton<ParticlePass>().set<GraphPass>(std::move(simulate_pass));
+
+    // Run pipeline
+    auto render = [](flecs::world &world, wgpu::RenderPassEncoder pass) {
+        auto &buffers = world.entity<ParticleInstances>().get<ParticleBuffers>();
+        if (buffers.args == nullptr || buffers.reset) {
+            return;
+        }
+
+        auto pipeline = world.entity<ParticlePipeline>();
+        auto render_pipeline = pipeline.get_mut<RenderPipeline>();
+        pass.setPipeline(render_pipeline.pipeline);
+        pipeline.each<Binds>([&](flecs::entity target) {
+            auto binding = pipeline.get<Binds>(target);
+            auto bind_group = target.get<Binding>();
+            pass.setBindGroup((uint32_t)binding.index, bind_group.group, 0, nullptr);
+        });
+        // Instance count written by the finish pass, same 4 vertex strip as the quad pipeline
+        pass.drawIndirect(buffers.args, 0);
+    };
+
+#ifndef EMSCRIPTEN
+    uniform_layout.addRef();
+#else
+    uniform_layout.reference();
+#endif
+    world.singleton<ParticlePipeline>()
+        .set<Binds, Uniforms>({0})
+        .set<Binds, ParticleInstances>({1})
+        .add<AntiAliased>()
+        // Particles have no entity, the quad shader would write id 0 over the shapes behind them
+        .add<NotPickable>()
+        .set<Shader>({ASSET_DIR "/shaders/quad.wgsl"})
+        .set<RenderPipeline>(
+            {{}, {uniform_layout, instance_layout}, wgpu::PrimitiveTopology::TriangleStrip})
+        .set<RenderFunction>({render});
+}
+
+} // namespace particle_pipeline
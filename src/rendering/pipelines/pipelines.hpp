@@ -5,13 +5,61 @@
 
 namespace quad_pipeline {
 
+// Work done packing shapes during the last frame, registered with reflection so it shows up in
+// the explorer. Tables are skipped when none of their shape columns changed.
+struct QuadStats {
+    uint32_t tables_processed;
+    uint32_t tables_skipped;
+    uint32_t shapes_packed;
+    uint32_t bytes_uploaded;
+};
+
 struct module {
     module(flecs::world &world);
 };
 } // namespace quad_pipeline
 
+namespace sprite_pipeline {
+
+// Draws quads with a (RenderTexture, Image) pair. Images are packed into the pages of a shared
+// atlas texture, images too large for it get a TextureArray per size.
+struct module {
+    module(flecs::world &world);
+};
+} // namespace sprite_pipeline
+
+namespace particle_pipeline {
+
+// Simulates ParticleEmitter particles in compute passes and draws them with the quad shader
+struct module {
+    module(flecs::world &world);
+};
+} // namespace particle_pipeline
+
+namespace line_pipeline {
+
+// Draws the DebugLines singleton in a single instanced call
+struct module {
+    module(flecs::world &world);
+};
+} // namespace line_pipeline
+
+namespace post_pipeline {
+
+// Bloom from Settings::bloom, fullscreen graph passes between the main pass and the surface
+struct module {
+    module(flecs::world &world);
+};
+} // namespace post_pipeline
+
 namespace pipelines {
 struct module {
-    module(flecs::world &world) { world.import <quad_pipeline::module>(); }
+    module(flecs::world &world) {
+        world.import <quad_pipeline::module>();
+        world.import <sprite_pipeline::module>();
+        world.import <particle_pipeline::module>();
+        world.import <line_pipeline::module>();
+        world.import <post_pipeline::module>();
+    }
 };
 } // namespace pipelines
\ No newline at end of file
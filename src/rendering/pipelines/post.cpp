@@ -0,0 +1,222 @@
+#include "../graph.hpp"
+#include "flecs.h"
+#include "pipelines.hpp"
+#include <cstdint>
+
+using namespace rendering;
+
+namespace post_pipeline {
+
+// Pixels glow once their brightest channel passes this
+constexpr float bloom_threshold = 0.8f;
+
+// Matches Params in post.wgsl
+struct PostParams {
+    float threshold;
+    float strength;
+    float padding[2];
+};
+
+// Shared by every post-processing step, the params follow the Settings
+struct PostResources {
+    wgpu::BindGroupLayout layout = nullptr;
+    wgpu::Sampler sampler = nullptr;
+    wgpu::Buffer params = nullptr;
+
+    static void on_remove(PostResources &value) {
+        value.layout.release();
+        value.sampler.release();
+        destroy_buffer(value.params);
+    }
+};
+
+// Textures a step samples, glow is only read by the composite
+struct PostStep {
+    flecs::entity_t source;
+    flecs::entity_t glow = 0;
+};
+
+// Half resolution transient textures. The blurred glow is only written after the bright pixels
+// were last read, so the graph backs both with the same texture.
+struct BrightTarget {};
+struct BlurTarget {};
+struct GlowTarget {};
+
+// Graph passes, each also holds the pipeline of its step
+struct BrightPass {};
+struct BlurXPass {};
+struct BlurYPass {};
+struct CompositePass {};
+
+static wgpu::BindGroupLayout init_layout(WGPU &webgpu) {
+    wgpu::BindGroupLayoutEntry entries[4];
+    for (uint32_t i = 0; i < 2; i++) {
+        entries[i].binding = i;
+        entries[i].visibility = wgpu::ShaderStage::Fragment;
+        entries[i].texture.sampleType = wgpu::TextureSampleType::Float;
+        entries[i].texture.viewDimension = wgpu::TextureViewDimension::_2D;
+        entries[i].texture.multisampled = false;
+    }
+
+    entries[2].binding = 2;
+    entries[2].visibility = wgpu::ShaderStage::Fragment;
+    entries[2].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+    entries[3].binding = 3;
+    entries[3].visibility = wgpu::ShaderStage::Fragment;
+    entries[3].buffer.type = wgpu::BufferBindingType::Uniform;
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc;
+    bind_group_layout_desc.entryCount = 4;
+    bind_group_layout_desc.entries = entries;
+    bind_group_layout_desc.label = toWgpuStringView("Post Bind Group Layout");
+
+    return webgpu.device.createBindGroupLayout(bind_group_layout_desc);
+}
+
+static wgpu::Sampler init_sampler(WGPU &webgpu) {
+    wgpu::SamplerDescriptor sampler_desc;
+    sampler_desc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.magFilter = wgpu::FilterMode::Linear;
+    sampler_desc.minFilter = wgpu::FilterMode::Linear;
+    sampler_desc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    sampler_desc.lodMinClamp = 0.0f;
+    sampler_desc.lodMaxClamp = 1.0f;
+    sampler_desc.compare = wgpu::CompareFunction::Undefined;
+    sampler_desc.maxAnisotropy = 1;
+    return webgpu.device.createSampler(sampler_desc);
+}
+
+// Fullscreen triangle sampling the step's textures
+static void draw_step(PassContext &context) {
+    flecs::entity e = context.pass;
+    const RenderPipeline &pipeline = e.get<RenderPipeline>();
+    if (!e.has<Ready>() || pipeline.pipeline == nullptr) {
+        return;
+    }
+
+    const PostStep &step = e.get<PostStep>();
+    wgpu::TextureView source = graph_texture(context.world, step.source);
+    wgpu::TextureView glow = step.glow != 0 ? graph_texture(context.world, step.glow) : source;
+    if (source == nullptr || glow == nullptr) {
+        return;
+    }
+
+    const PostResources &resources = context.world.get<PostResources>();
+    wgpu::BindGroupEntry entries[4];
+    entries[0].binding = 0;
+    entries[0].textureView = source;
+    entries[1].binding = 1;
+    entries[1].textureView = glow;
+    entries[2].binding = 2;
+    entries[2].sampler = resources.sampler;
+    entries[3].binding = 3;
+    entries[3].buffer = resources.params;
+    entries[3].offset = 0;
+    entries[3].size = sizeof(PostParams);
+
+    wgpu::BindGroupDescriptor descriptor;
+    descriptor.layout = resources.layout;
+    descriptor.entryCount = 4;
+    descriptor.entries = entries;
+    // Transient views can be backed by another texture next frame, so the group isn't kept
+    wgpu::BindGroup group = context.world.get<WGPU>().device.createBindGroup(descriptor);
+
+    context.render.setPipeline(pipeline.pipeline);
+    context.render.setBindGroup(0, group, 0, nullptr);
+    context.render.draw(3, 1, 0, 0);
+    group.release();
+}
+
+// Write the params and add the composite while bloom is on. Without it nothing reads the glow, so
+// the graph culls the other steps and never allocates their textures.
+static void apply_settings(flecs::world &world, const Settings &settings) {
+    PostParams params{bloom_threshold, settings.bloom, {}};
+    const PostResources &resources = world.get<PostResources>();
+    world.get<WGPU>().queue.writeBuffer(resources.params, 0, &params, sizeof(PostParams));
+
+    if (settings.bloom <= 0.0f) {
+        world.entity<CompositePass>().remove<GraphPass>();
+        return;
+    }
+
+    GraphPass composite;
+    composite.reads = {world.entity<SceneColor>(), world.entity<GlowTarget>()};
+    Attachment surface;
+    surface.resource = world.entity<SurfaceTarget>();
+    composite.colors.push_back(surface);
+    composite.execute = draw_step;
+    world.entity<CompositePass>().set<GraphPass>(std::move(composite));
+}
+
+module::module(flecs::world &world) {
+    WGPU &webgpu = world.ensure<WGPU>();
+    world.component<PostResources>().on_remove(&PostResources::on_remove);
+    world.component<PostStep>();
+
+    PostResources resources;
+    resources.layout = init_layout(webgpu);
+    resources.sampler = init_sampler(webgpu);
+    wgpu::BufferDescriptor buffer_desc;
+    // Cast required for emscripten
+    buffer_desc.usage =
+        (wgpu::BufferUsage::W)(wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst);
+    buffer_desc.mappedAtCreation = false;
+    buffer_desc.size = sizeof(PostParams);
+    resources.params = create_buffer(webgpu.device, buffer_desc);
+    wgpu::BindGroupLayout layout = resources.layout;
+    world.set<PostResources>(std::move(resources));
+
+    TransientTexture half;
+    half.downscale = 2;
+    world.entity<BrightTarget>().set<TransientTexture>(half);
+    world.entity<BlurTarget>().set<TransientTexture>(half);
+    world.entity<GlowTarget>().set<TransientTexture>(half);
+
+    // Every pipeline releases its group layout when removed, the resources keep their own
+    auto step = [&](flecs::entity e, const char *entry_point, PostStep textures,
+                    flecs::entity_t target) {
+#ifndef EMSCRIPTEN
+        layout.addRef();
+#else
+        layout.reference();
+#endif
+        RenderPipeline pipeline;
+        pipeline.group_layouts = {layout};
+        pipeline.fragment_entry_point = entry_point;
+        e.add<PostProcess>()
+            .set<PostStep>(textures)
+            .set<Shader>({ASSET_DIR "/shaders/post.wgsl"})
+            .set<RenderPipeline>(std::move(pipeline));
+        if (target == 0) {
+            return;
+        }
+
+        GraphPass pass;
+        pass.reads = {textures.source};
+        Attachment color;
+        color.resource = target;
+        pass.colors.push_back(color);
+        pass.execute = draw_step;
+        e.set<GraphPass>(std::move(pass));
+    };
+    flecs::entity_t scene = world.entity<SceneColor>();
+    flecs::entity_t bright = world.entity<BrightTarget>();
+    flecs::entity_t blur = world.entity<BlurTarget>();
+    flecs::entity_t glow = world.entity<GlowTarget>();
+    step(world.singleton<BrightPass>(), "fs_bright", {scene}, bright);
+    step(world.singleton<BlurXPass>(), "fs_blur_x", {bright}, blur);
+    step(world.singleton<BlurYPass>(), "fs_blur_y", {blur}, glow);
+    // The composite's pass follows the settings
+    step(world.singleton<CompositePass>(), "fs_composite", {scene, glow}, 0);
+
+    apply_settings(world, world.get<Settings>());
+    world.observer<Settings>().event(flecs::OnSet).each([](flecs::entity e, Settings &settings) {
+        flecs::world world = e.world();
+        apply_settings(world, settings);
+    });
+}
+
+} // namespace post_pipeline
@@ -1,69 +1,252 @@
 #include "../../common.hpp"
+#include "../arena.hpp"
+#include "../mirror.hpp"
 #include "flecs.h"
+#include "packing.hpp"
 #include "pipelines.hpp"
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <unordered_map>
 
 using namespace rendering;
 
 namespace quad_pipeline {
 
-struct BufferData {
-    std::array<float, 14> data;
-    std::array<float, 2> padding;
+// Packed shapes of a single table, kept until one of its columns changes
+struct TableCache {
+    std::vector<BufferData> opaque;
+    std::vector<BufferData> blended;
+    bool layered = false;
+    // Offsets into the instance buffer the shapes were last written to
+    size_t opaque_offset = SIZE_MAX;
+    size_t blended_offset = SIZE_MAX;
+    // Tables that weren't matched during the last pack are dropped
+    uint64_t generation = 0;
 };
 
+// Shapes are uploaded as one buffer, opaque shapes first. Packing is persistent per table, tables
+// whose columns didn't change are neither repacked nor uploaded again.
 struct InstanceBuffer {
+    flecs::query<const Quad, const Position, const Color, const Layer *> quads;
+    flecs::query<const Circle, const Position, const Color, const Layer *> circles;
+    flecs::query<const Shapes, const Position, const Layer *> compounds;
+    std::unordered_map<const flecs::table_t *, TableCache> tables;
     std::vector<BufferData> data;
+    uint64_t generation = 0;
+    uint32_t opaque_count = 0;
+    bool split = false;
 };
 
-std::vector<float> quad_vertices = {
-    -1.0, 1.0, 0.0, 1.0, 1.0, 0.0, 1.0, -1.0, 0.0, 1.0, -1.0, 0.0, -1.0, -1.0, 0.0, -1.0, 1.0, 0.0,
-};
+static float layer_of(const BufferData &shape) { return shape.data[11]; }
+
+// Move translucent shapes packed into the opaque rows out in order
+static void split_blended(TableCache &cache, bool layered) {
+    cache.layered = layered;
+    // Force the table to be written to the buffer again
+    cache.opaque_offset = SIZE_MAX;
+    cache.blended_offset = SIZE_MAX;
 
-wgpu::VertexBufferLayout init_vertex_layout() {
-    using namespace wgpu;
+    auto &opaque = cache.opaque;
+    cache.blended.clear();
+    size_t kept = 0;
+    for (size_t i = 0; i < opaque.size(); i++) {
+        if (opaque[i].data[3] >= 1.0f) {
+            opaque[kept++] = opaque[i];
+        } else {
+            cache.blended.push_back(opaque[i]);
+        }
+    }
+    opaque.resize(kept);
+}
 
-    VertexAttribute *attrib = new VertexAttribute();
-    attrib->shaderLocation = 0;
-    attrib->format = VertexFormat::Float32x3;
-    attrib->offset = 0;
+template <typename Shape> static void pack_table(flecs::iter &it, TableCache &cache) {
+    bool layered = it.is_set(3);
+    ShapeColumns<Shape> columns{
+        &it.field<const Shape>(0)[0],
+        &it.field<const Position>(1)[0],
+        &it.field<const Color>(2)[0],
+        layered ? &it.field<const Layer>(3)[0] : nullptr,
+        it.c_ptr()->entities,
+        it.count(),
+    };
+
+    // Pack the whole table as opaque, then move translucent shapes out in order
+    cache.opaque.resize(columns.count);
+    pack(columns, cache.opaque.data());
+    split_blended(cache, layered);
+}
 
-    VertexBufferLayout layout;
-    layout.attributeCount = 1;
-    layout.attributes = attrib;
-    layout.arrayStride = 3 * sizeof(float);
-    layout.stepMode = VertexStepMode::Vertex;
+// Every box and circle part of every entity, one row per part in the order of the parts
+template <> void pack_table<Shapes>(flecs::iter &it, TableCache &cache) {
+    bool layered = it.is_set(2);
+    auto shapes = it.field<const Shapes>(0);
+    auto positions = it.field<const Position>(1);
+    const flecs::entity_t *entities = it.c_ptr()->entities;
+
+    cache.opaque.clear();
+    for (size_t i = 0; i < it.count(); i++) {
+        const Position &pos = positions[i];
+        float layer = layered ? it.field<const Layer>(2)[i].value : 0.0f;
+        float c = std::cos(pos.rotation);
+        float s = std::sin(pos.rotation);
+
+        for (const ShapePart &part : shapes[i].parts) {
+            ShapeSize size;
+            if (part.kind == ShapePart::Kind::Box) {
+                size = {part.width, part.height, part.corner_radius};
+            } else if (part.kind == ShapePart::Kind::Circle) {
+                size = shape_size(Circle{part.radius});
+            } else {
+                continue;
+            }
+
+            cache.opaque.push_back({{
+                                        part.color[0],
+                                        part.color[1],
+                                        part.color[2],
+                                        part.color[3],
+                                        size.corner_radius,
+                                        size.corner_radius,
+                                        size.corner_radius,
+                                        size.corner_radius,
+                                        pos.x + c * part.x - s * part.y,
+                                        pos.y + s * part.x + c * part.y,
+                                        pos.rotation + part.rotation,
+                                        layer,
+                                        size.width,
+                                        size.height,
+                                    },
+                                    (uint32_t)entities[i],
+                                    0});
+        }
+    }
+    split_blended(cache, layered);
+}
 
-    return layout;
+// Tables in the order they were matched, only needed while packing
+using TableOrder = FrameVector<TableCache *>;
+
+// Repack tables that changed since the last frame
+template <typename Shape, typename Query>
+static void pack_tables(InstanceBuffer &buffer, TableOrder &order, Query &query,
+                        QuadStats &stats) {
+    query.run([&](flecs::iter &it) {
+        while (it.next()) {
+            auto [entry, inserted] = buffer.tables.try_emplace(it.c_ptr()->table);
+            TableCache &cache = entry->second;
+            if (inserted || it.changed()) {
+                pack_table<Shape>(it, cache);
+                stats.tables_processed++;
+                stats.shapes_packed += (uint32_t)(cache.opaque.size() + cache.blended.size());
+            } else {
+                stats.tables_skipped++;
+            }
+            cache.generation = buffer.generation;
+            order.push_back(&cache);
+        }
+    });
+}
+
+// Shape placed by layer, the sequence keeps the draw order of shapes on the same layer
+struct LayerKey {
+    float layer;
+    uint32_t sequence;
+    const BufferData *shape;
 };
 
-wgpu::BindGroupLayout init_bind_group_layout(WGPU &webgpu) {
-    using namespace wgpu;
+// Copy packed tables into the instance buffer, returns the range of shapes that needs uploading
+static std::pair<size_t, size_t> assemble(InstanceBuffer &buffer, const TableOrder &order,
+                                          bool split, Arena &arena) {
+    size_t opaque_count = 0;
+    size_t count = 0;
+    bool layered = false;
+    for (TableCache *cache : order) {
+        opaque_count += cache->opaque.size();
+        count += cache->opaque.size() + cache->blended.size();
+        layered |= cache->layered;
+    }
+
+    auto &data = buffer.data;
+    data.resize(count);
+    buffer.opaque_count = split ? (uint32_t)opaque_count : 0;
 
-    BindGroupLayoutEntry entry;
-    entry.binding = 0;
-    entry.buffer.type = BufferBindingType::ReadOnlyStorage;
-    entry.visibility = ShaderStage::Vertex;
+    // Opaque shapes front to back so hidden fragments fail the depth test early, blended
+    // shapes back to front. Without a depth target every shape is blended in layer order.
+    // Keys point into the table caches, so every shape is copied once, straight to its place.
+    if (layered) {
+        FrameVector<LayerKey> keys{arena};
+        keys.reserve(count);
+        auto add_keys = [&](const std::vector<BufferData> &shapes) {
+            for (const BufferData &shape : shapes) {
+                // Negated in the opaque range so both ranges sort ascending
+                bool opaque = keys.size() < buffer.opaque_count;
+                float layer = opaque ? -layer_of(shape) : layer_of(shape);
+                keys.push_back({layer, (uint32_t)keys.size(), &shape});
+            }
+        };
+        for (TableCache *cache : order) {
+            add_keys(cache->opaque);
+        }
+        for (TableCache *cache : order) {
+            add_keys(cache->blended);
+        }
 
-    BindGroupLayoutDescriptor bind_group_layout_desc;
-    bind_group_layout_desc.entryCount = 1;
-    bind_group_layout_desc.entries = &entry;
-    bind_group_layout_desc.label = toWgpuStringView("Quad Instance Bind Group Layout");
+        auto by_layer = [](const LayerKey &a, const LayerKey &b) {
+            return a.layer < b.layer || (a.layer == b.layer && a.sequence < b.sequence);
+        };
+        auto blended_begin = keys.begin() + buffer.opaque_count;
+        std::sort(keys.begin(), blended_begin, by_layer);
+        std::sort(blended_begin, keys.end(), by_layer);
+        for (size_t i = 0; i < count; i++) {
+            data[i] = *keys[i].shape;
+        }
+
+        // Sorting moved shapes away from their table offsets
+        for (TableCache *cache : order) {
+            cache->opaque_offset = SIZE_MAX;
+            cache->blended_offset = SIZE_MAX;
+        }
+        return {0, count};
+    }
 
-    return webgpu.device.createBindGroupLayout(bind_group_layout_desc);
+    // Tables only need writing when they were repacked or moved
+    size_t dirty_begin = count;
+    size_t dirty_end = 0;
+    size_t offset = 0;
+    auto place = [&](std::vector<BufferData> &shapes, size_t &cached_offset) {
+        if (cached_offset != offset) {
+            std::copy(shapes.begin(), shapes.end(), data.begin() + offset);
+            dirty_begin = std::min(dirty_begin, offset);
+            dirty_end = std::max(dirty_end, offset + shapes.size());
+        }
+        cached_offset = offset;
+        offset += shapes.size();
+    };
+    for (TableCache *cache : order) {
+        place(cache->opaque, cache->opaque_offset);
+    }
+    for (TableCache *cache : order) {
+        place(cache->blended, cache->blended_offset);
+    }
+
+    return {std::min(dirty_begin, dirty_end), dirty_end};
 }
 
 struct QuadPipeline {};
 
+// Same shader without blending, used for opaque shapes when the main pass has a depth target
+struct QuadOpaquePipeline {};
+
 struct QuadInstanceBuffer {};
 
 module::module(flecs::world &world) {
     WGPU &webgpu = world.ensure<WGPU>();
-    auto vertex_layout = init_vertex_layout();
-    auto instance_layout = init_bind_group_layout(webgpu);
+    auto instance_layout =
+        init_storage_layout(webgpu, wgpu::ShaderStage::Vertex, "Quad Instance Bind Group Layout");
     auto &uniform_layout = world.entity<Uniforms>().get<BindingLayout>().layout.value();
-    auto &quad_vertex_buffer = world.entity().set<VertexBuffer>({vertex_layout});
 
     world.singleton<QuadInstanceBuffer>()
         .add<QuadInstanceBuffer>()
@@ -72,103 +255,141 @@ module::module(flecs::world &world) {
             {(wgpu::BufferUsage::W)(wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst)})
         .set<BindingLayout>({instance_layout})
         .add<Binding>()
-        .set<InstanceBuffer>({});
-
-    auto buffer = quad_vertex_buffer.get_mut<Buffer>();
-    buffer.write_buffer(webgpu, quad_vertices);
-
-    world.system<InstanceBuffer, Quad, Position, Color>()
-        .term_at(0)
-        .src<QuadInstanceBuffer>()
-        .kind<RenderSystems::Initialize>()
-        .each([](InstanceBuffer &buffer, Quad &quad, Position &pos, Color &color) {
-            BufferData data{{
-                                color.color[0],
-                                color.color[1],
-                                color.color[2],
-                                color.color[3],
-                                quad.corner_radius,
-                                quad.corner_radius,
-                                quad.corner_radius,
-                                quad.corner_radius,
-                                pos.x,
-                                pos.y,
-                                pos.rotation,
-                                0.0f,
-                                quad.width,
-                                quad.height,
-                            },
-                            {0.0f, 0.0f}};
-            buffer.data.push_back(data);
+        .set<InstanceBuffer>({
+            world.query_builder<const Quad, const Position, const Color, const Layer *>()
+                // Textured quads are drawn by the sprite pipeline, their Color is a tint
+                .without<RenderTexture>(flecs::Wildcard)
+                .cached()
+                .detect_changes()
+                .build(),
+            world.query_builder<const Circle, const Position, const Color, const Layer *>()
+                .cached()
+                .detect_changes()
+                .build(),
+            world.query_builder<const Shapes, const Position, const Layer *>()
+                .cached()
+                .detect_changes()
+                .build(),
         });
 
-    world.system<InstanceBuffer, Circle, Position, Color>()
-        .term_at(0)
-        .src<QuadInstanceBuffer>()
-        .kind<RenderSystems::Initialize>()
-        .each([](InstanceBuffer &buffer, Circle &circle, Position &pos, Color &color) {
-            BufferData data{{
-                                color.color[0],
-                                color.color[1],
-                                color.color[2],
-                                color.color[3],
-                                circle.radius,
-                                circle.radius,
-                                circle.radius,
-                                circle.radius,
-                                pos.x,
-                                pos.y,
-                                pos.rotation,
-                                0.0f,
-                                circle.radius * 2.0f,
-                                circle.radius * 2.0f,
-                            },
-                            {0.0f, 0.0f}};
-            buffer.data.push_back(data);
-        });
+    world.component<QuadStats>()
+        .member<uint32_t>("tables_processed")
+        .member<uint32_t>("tables_skipped")
+        .member<uint32_t>("shapes_packed")
+        .member<uint32_t>("bytes_uploaded");
+    world.set<QuadStats>({});
 
     // Update buffer
-    world.system<WGPU, Buffer, Binding, BindingLayout, InstanceBuffer>()
+    world.system<WGPU, QuadStats, Buffer, Binding, BindingLayout, InstanceBuffer>()
         .term_at(0)
         .singleton()
+        .term_at(1)
+        .singleton()
         .with<QuadInstanceBuffer>()
         .kind<RenderSystems::Prepare>()
-        .each([=](WGPU &webgpu, Buffer &render_buffer, Binding &binding, BindingLayout &layout,
-                  InstanceBuffer &data_buffer) {
-            render_buffer.write_buffer(webgpu, data_buffer.data);
-            if (data_buffer.data.size() > 0) {
-                render_buffer.update_bind_group(webgpu, binding, layout);
-                data_buffer.data.clear();
+        .each([](flecs::entity e, WGPU &webgpu, QuadStats &stats, Buffer &render_buffer,
+                 Binding &binding, BindingLayout &layout, InstanceBuffer &instances) {
+            stats = {};
+
+            bool split = e.world().has<DepthTarget>();
+            // changed() only compares against the last iteration, packing below iterates all
+            // three queries so the next frame compares against this one
+            bool quads_changed = instances.quads.changed();
+            bool circles_changed = instances.circles.changed();
+            bool compounds_changed = instances.compounds.changed();
+            if (!quads_changed && !circles_changed && !compounds_changed &&
+                split == instances.split &&
+                render_buffer.buffer != nullptr) {
+                stats.tables_skipped = (uint32_t)instances.tables.size();
+                return;
+            }
+
+            flecs::world world = e.world();
+            Arena &arena = frame_arena(world);
+            TableOrder order{arena};
+            order.reserve(instances.tables.size());
+
+            instances.generation++;
+            pack_tables<Quad>(instances, order, instances.quads, stats);
+            pack_tables<Circle>(instances, order, instances.circles, stats);
+            pack_tables<Shapes>(instances, order, instances.compounds, stats);
+            for (auto it = instances.tables.begin(); it != instances.tables.end();) {
+                if (it->second.generation != instances.generation) {
+                    it = instances.tables.erase(it);
+                } else {
+                    it++;
+                }
+            }
+
+            auto [dirty_begin, dirty_end] = assemble(instances, order, split, arena);
+            instances.split = split;
+
+            auto &data = instances.data;
+            if (render_buffer.buffer == nullptr || render_buffer.count != data.size()) {
+                render_buffer.write_buffer(webgpu, data);
+                if (data.size() > 0) {
+                    render_buffer.update_bind_group(webgpu, binding, layout);
+                }
+                stats.bytes_uploaded = (uint32_t)(data.size() * sizeof(BufferData));
+            } else if (dirty_end > dirty_begin) {
+                webgpu.queue.writeBuffer(render_buffer.buffer, dirty_begin * sizeof(BufferData),
+                                         data.data() + dirty_begin,
+                                         (dirty_end - dirty_begin) * sizeof(BufferData));
+                stats.bytes_uploaded = (uint32_t)((dirty_end - dirty_begin) * sizeof(BufferData));
             }
         });
 
     // Run pipeline
-    auto render = [=](flecs::world &world, wgpu::RenderPassEncoder pass) {
-        auto pipeline = world.entity<QuadPipeline>();
-        auto render_pipeline = pipeline.get_mut<RenderPipeline>();
+    auto render = [](flecs::world &world, wgpu::RenderPassEncoder pass) {
         auto instance_buffer = world.entity<QuadInstanceBuffer>().get_mut<Buffer>();
-        auto vertex_buffer = quad_vertex_buffer.get_mut<Buffer>();
+        auto &instances = world.entity<QuadInstanceBuffer>().get<InstanceBuffer>();
 
-        if (instance_buffer.count > 0) {
+        auto draw = [&](flecs::entity pipeline, uint32_t count, uint32_t first) {
+            if (count == 0) {
+                return;
+            }
+            auto render_pipeline = pipeline.get_mut<RenderPipeline>();
             pass.setPipeline(render_pipeline.pipeline);
-            pass.setVertexBuffer(0, vertex_buffer.buffer, 0,
-                                 vertex_buffer.count * vertex_buffer.item_size);
             pipeline.each<Binds>([&](flecs::entity target) {
                 auto binding = pipeline.get<Binds>(target);
                 auto bind_group = target.get<Binding>();
                 pass.setBindGroup((uint32_t)binding.index, bind_group.group, 0, nullptr);
             });
-            pass.draw(6, (uint32_t)instance_buffer.count, 0, 0);
-        }
+            // Corners are generated from the vertex index as a 4 vertex strip
+            pass.draw(4, count, 0, first);
+        };
+
+        uint32_t count = (uint32_t)instance_buffer.count;
+        uint32_t opaque_count = std::min(instances.opaque_count, count);
+        draw(world.entity<QuadOpaquePipeline>(), opaque_count, 0);
+        draw(world.entity<QuadPipeline>(), count - opaque_count, opaque_count);
     };
 
     world.singleton<QuadPipeline>()
-        .add<PipelineVertices>(quad_vertex_buffer)
         .set<Binds, Uniforms>({0})
         .set<Binds, QuadInstanceBuffer>({1})
+        .add<AntiAliased>()
         .set<Shader>({ASSET_DIR "/shaders/quad.wgsl"})
-        .set<RenderPipeline>({vertex_layout, {uniform_layout, instance_layout}})
+        .set<RenderPipeline>(
+            {{}, {uniform_layout, instance_layout}, wgpu::PrimitiveTopology::TriangleStrip})
         .set<RenderFunction>({render});
+
+    // Both pipelines release their group layouts when removed
+#ifndef EMSCRIPTEN
+    uniform_layout.addRef();
+    instance_layout.addRef();
+#else
+    uniform_layout.reference();
+    instance_layout.reference();
+#endif
+    world.singleton<QuadOpaquePipeline>()
+        .set<Binds, Uniforms>({0})
+        .set<Binds, QuadInstanceBuffer>({1})
+        .add<AntiAliased>()
+        .add<DepthWrite>()
+        .set<Shader>({ASSET_DIR "/shaders/quad.wgsl"})
+        .set<RenderPipeline>(
+            {{}, {uniform_layout, instance_layout}, wgpu::PrimitiveTopology::TriangleStrip});
 }
 
 } // namespace quad_pipeline
\ No newline at end of file
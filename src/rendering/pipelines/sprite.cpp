@@ -0,0 +1,725 @@
+#include "../arena.hpp"
+#include "../atlas.hpp"
+#include "../mirror.hpp"
+#include "flecs.h"
+#include "pipelines.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace rendering;
+
+namespace sprite_pipeline {
+
+// One row of the sprite instance buffer, matches the Sprite struct in sprite.wgsl
+struct SpriteData {
+    std::array<float, 4> color;
+    std::array<float, 4> uv;
+    std::array<float, 4> position;
+    std::array<float, 2> size;
+    uint32_t texture_layer;
+    uint32_t id;
+};
+
+static_assert(sizeof(SpriteData) == 16 * sizeof(float), "SpriteData must be four vec4 rows");
+
+// Texels around every atlas image repeating its edge, so linear filtering never samples the
+// image next to it
+constexpr uint32_t atlas_padding = 1;
+
+struct AtlasPage {
+    SkylinePacker packer;
+    // Padded area of the images removed since the page was last packed
+    uint64_t freed_area = 0;
+};
+
+// Atlas pages are the layers of a single texture, so every sprite drawn from the atlas shares one
+// bind group. Images keep their ImageData so pages can be packed again and the texture recreated
+// without going back to disk.
+struct Atlas {
+    std::vector<AtlasPage> pages;
+    uint32_t page_size = 0;
+    wgpu::BindGroupLayout texture_layout = nullptr;
+    wgpu::Texture texture = nullptr;
+    wgpu::TextureView view = nullptr;
+    wgpu::Sampler sampler = nullptr;
+    wgpu::BindGroup group = nullptr;
+    // Layers the texture was created with
+    uint32_t layers = 0;
+
+    flecs::query<const ImageData> pending;
+    flecs::query<const ImageData, const AtlasRegion> packed;
+    flecs::query<> dirty_arrays;
+    // Images in any TextureArray, filtered by their array target when one is rebuilt
+    flecs::query<const ImageData> array_images;
+
+    // Scratch kept between frames so packing only allocates while the atlas grows
+    std::vector<uint8_t> padded;
+    std::vector<flecs::entity> uploads;
+    std::vector<flecs::entity> pending_images;
+    std::vector<flecs::entity> images;
+    std::vector<flecs::entity> rebuilt_arrays;
+
+    Atlas() = default;
+    Atlas(const Atlas &) = delete;
+    Atlas(Atlas &&) = default;
+    Atlas &operator=(Atlas &&) = default;
+
+    void release_texture() {
+        if (group != nullptr) {
+            group.release();
+            group = nullptr;
+        }
+        if (view != nullptr) {
+            view.release();
+            view = nullptr;
+        }
+        destroy_texture(texture);
+        layers = 0;
+    }
+
+    static void on_remove(Atlas &value) {
+        value.release_texture();
+        if (value.sampler != nullptr) {
+            value.sampler.release();
+        }
+        if (value.texture_layout != nullptr) {
+            value.texture_layout.release();
+        }
+    }
+};
+
+// TextureArray whose images changed, rebuilt during the next pack
+struct ArrayDirty {};
+
+// Consecutive sprites drawn from the same texture
+struct SpriteBatch {
+    // 0 for the atlas, the TextureArray entity otherwise
+    flecs::entity_t texture;
+    uint32_t first;
+    uint32_t count;
+};
+
+// Sprite with the keys it is drawn in order of
+struct SpriteRow {
+    float layer;
+    flecs::entity_t texture;
+    SpriteData data;
+};
+
+// Sorting moves these instead of whole rows
+struct SpriteKey {
+    float layer;
+    flecs::entity_t texture;
+    uint32_t row;
+};
+
+struct SpriteInstances {
+    flecs::query<const Quad, const Position, const Color *, const Layer *> sprites;
+    std::vector<SpriteRow> rows;
+    std::vector<SpriteData> data;
+    std::vector<SpriteBatch> batches;
+};
+
+struct SpritePipeline {};
+
+struct SpriteInstanceBuffer {};
+
+static wgpu::BindGroupLayout init_texture_layout(WGPU &webgpu) {
+    wgpu::BindGroupLayoutEntry entries[2];
+    entries[0].binding = 0;
+    entries[0].visibility = wgpu::ShaderStage::Fragment;
+    entries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+    entries[0].texture.viewDimension = wgpu::TextureViewDimension::_2DArray;
+    entries[0].texture.multisampled = false;
+
+    entries[1].binding = 1;
+    entries[1].visibility = wgpu::ShaderStage::Fragment;
+    entries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc;
+    bind_group_layout_desc.entryCount = 2;
+    bind_group_layout_desc.entries = entries;
+    bind_group_layout_desc.label = toWgpuStringView("Sprite Texture Bind Group Layout");
+
+    return webgpu.device.createBindGroupLayout(bind_group_layout_desc);
+}
+
+static wgpu::Sampler init_sampler(WGPU &webgpu) {
+    wgpu::SamplerDescriptor sampler_desc;
+    sampler_desc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.magFilter = wgpu::FilterMode::Linear;
+    sampler_desc.minFilter = wgpu::FilterMode::Linear;
+    sampler_desc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    sampler_desc.lodMinClamp = 0.0f;
+    sampler_desc.lodMaxClamp = 1.0f;
+    sampler_desc.compare = wgpu::CompareFunction::Undefined;
+    sampler_desc.maxAnisotropy = 1;
+    return webgpu.device.createSampler(sampler_desc);
+}
+
+// RGBA texture with one layer per page or image, viewed as an array even with a single layer
+static void init_array_texture(WGPU &webgpu, uint32_t width, uint32_t height, uint32_t layers,
+                               wgpu::Texture &texture, wgpu::TextureView &view) {
+    wgpu::TextureDescriptor texture_desc;
+    texture_desc.dimension = wgpu::TextureDimension::_2D;
+    texture_desc.format = wgpu::TextureFormat::RGBA8Unorm;
+    texture_desc.mipLevelCount = 1;
+    texture_desc.sampleCount = 1;
+    texture_desc.size = {width, height, layers};
+    // Cast required for emscripten
+    texture_desc.usage = (wgpu::TextureUsage::W)(wgpu::TextureUsage::TextureBinding |
+                                                 wgpu::TextureUsage::CopyDst);
+    texture_desc.viewFormatCount = 0;
+    texture_desc.viewFormats = nullptr;
+    texture = create_texture(webgpu.device, texture_desc);
+
+    wgpu::TextureViewDescriptor view_desc;
+    view_desc.label = toWgpuStringView("Sprite texture view");
+    view_desc.format = wgpu::TextureFormat::RGBA8Unorm;
+    view_desc.dimension = WGPUTextureViewDimension_2DArray;
+    view_desc.baseMipLevel = 0;
+    view_desc.mipLevelCount = 1;
+    view_desc.baseArrayLayer = 0;
+    view_desc.arrayLayerCount = layers;
+    view_desc.aspect = WGPUTextureAspect_All;
+    view = texture.createView(view_desc);
+}
+
+static wgpu::BindGroup init_texture_group(WGPU &webgpu, wgpu::BindGroupLayout layout,
+                                          wgpu::TextureView view, wgpu::Sampler sampler) {
+    wgpu::BindGroupEntry entries[2];
+    entries[0].binding = 0;
+    entries[0].textureView = view;
+    entries[1].binding = 1;
+    entries[1].sampler = sampler;
+
+    wgpu::BindGroupDescriptor descriptor;
+    descriptor.layout = layout;
+    descriptor.entryCount = 2;
+    descriptor.entries = entries;
+    return webgpu.device.createBindGroup(descriptor);
+}
+
+static void write_texture(WGPU &webgpu, wgpu::Texture texture, uint32_t x, uint32_t y,
+                          uint32_t layer, uint32_t width, uint32_t height, const uint8_t *data) {
+#ifndef EMSCRIPTEN
+    wgpu::TexelCopyTextureInfo destination;
+    wgpu::TexelCopyBufferLayout layout;
+#else
+    wgpu::ImageCopyTexture destination;
+    wgpu::TextureDataLayout layout;
+#endif
+    destination.texture = texture;
+    destination.mipLevel = 0;
+    destination.origin.x = x;
+    destination.origin.y = y;
+    destination.origin.z = layer;
+    destination.aspect = wgpu::TextureAspect::All;
+
+    layout.offset = 0;
+    layout.bytesPerRow = 4 * width;
+    layout.rowsPerImage = height;
+
+    webgpu.queue.writeTexture(destination, data, 4 * width * height, layout, {width, height, 1});
+}
+
+// Upload an image into its atlas region along with the padding around it
+static void upload_region(WGPU &webgpu, Atlas &atlas, const ImageData &image,
+                          const AtlasRegion &region) {
+    uint32_t width = image.width + 2 * atlas_padding;
+    uint32_t height = image.height + 2 * atlas_padding;
+    atlas.padded.resize((size_t)width * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        uint32_t source_y = std::clamp(y, atlas_padding, atlas_padding + image.height - 1);
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t source_x = std::clamp(x, atlas_padding, atlas_padding + image.width - 1);
+            size_t source = ((size_t)(source_y - atlas_padding) * image.width + source_x -
+                             atlas_padding) * 4;
+            std::memcpy(&atlas.padded[((size_t)y * width + x) * 4], image.data + source, 4);
+        }
+    }
+    write_texture(webgpu, atlas.texture, region.x - atlas_padding, region.y - atlas_padding,
+                  region.page, width, height, atlas.padded.data());
+}
+
+static uint64_t padded_area(uint32_t width, uint32_t height) {
+    return (uint64_t)(width + 2 * atlas_padding) * (height + 2 * atlas_padding);
+}
+
+static bool insert_into_page(Atlas &atlas, uint32_t page, const ImageData &image,
+                             AtlasRegion &region) {
+    uint32_t x, y;
+    if (!atlas.pages[page].packer.insert(image.width + 2 * atlas_padding,
+                                         image.height + 2 * atlas_padding, x, y)) {
+        return false;
+    }
+    region = {page, x + atlas_padding, y + atlas_padding, image.width, image.height};
+    return true;
+}
+
+// Pack the live images of the page again from the tallest down. Images that no longer fit lose
+// their region and are placed with the pending images.
+static void repack_page(Atlas &atlas, uint32_t page) {
+    std::vector<flecs::entity> &images = atlas.images;
+    images.clear();
+    atlas.packed.each([&](flecs::entity e, const ImageData &, const AtlasRegion &region) {
+        if (region.page == page) {
+            images.push_back(e);
+        }
+    });
+    std::sort(images.begin(), images.end(), [](flecs::entity a, flecs::entity b) {
+        const ImageData &image_a = a.get<ImageData>();
+        const ImageData &image_b = b.get<ImageData>();
+        if (image_a.height != image_b.height) {
+            return image_a.height > image_b.height;
+        }
+        return image_a.width > image_b.width;
+    });
+
+    atlas.pages[page].packer.reset(atlas.page_size, atlas.page_size);
+    for (flecs::entity e : images) {
+        AtlasRegion region;
+        if (insert_into_page(atlas, page, e.get<ImageData>(), region)) {
+            e.set<AtlasRegion>(region);
+            atlas.uploads.push_back(e);
+        } else {
+            e.remove<AtlasRegion>();
+        }
+    }
+    atlas.pages[page].freed_area = 0;
+}
+
+// Images too large for the atlas share a TextureArray with every other image of their size
+static void add_to_array(flecs::world &world, flecs::entity image, const ImageData &data) {
+    TextureArrayCache &cache = world.ensure<TextureArrayCache>();
+    TextureArrayKey key{data.width, data.height};
+    auto it = cache.map.find(key);
+    flecs::entity array;
+    if (it == cache.map.end() || !world.is_alive(it->second)) {
+        TextureArray texture_array;
+        texture_array.mip_sizes = {{data.width, data.height, 0}};
+        array = world.entity().set<TextureArray>(texture_array).add<Binding>();
+        cache.map[key] = array;
+    } else {
+        array = world.entity(it->second);
+    }
+    image.set<TextureArrayIndex>(array, {UINT32_MAX});
+    array.add<ArrayDirty>();
+}
+
+// Recreate the texture of an array with a layer for every image still in it
+static void rebuild_array(flecs::world &world, WGPU &webgpu, Atlas &atlas, flecs::entity array) {
+    std::vector<flecs::entity> &images = atlas.images;
+    images.clear();
+    atlas.array_images.each([&](flecs::iter &it, size_t i, const ImageData &) {
+        if (it.pair(1).second() == array) {
+            images.push_back(it.entity(i));
+        }
+    });
+
+    TextureArray &texture_array = array.get_mut<TextureArray>();
+    Binding &binding = array.get_mut<Binding>();
+    if (binding.group != nullptr) {
+        binding.group.release();
+        binding.group = nullptr;
+    }
+    if (texture_array.view != nullptr) {
+        texture_array.view.release();
+        texture_array.view = nullptr;
+    }
+    destroy_texture(texture_array.texture);
+
+    wgpu::Extent3D size = texture_array.size();
+    if (images.empty()) {
+        world.ensure<TextureArrayCache>().map.erase(TextureArrayKey{size.width, size.height});
+        array.destruct();
+        return;
+    }
+
+    texture_array.count = (uint32_t)images.size();
+    init_array_texture(webgpu, size.width, size.height, texture_array.count,
+                       texture_array.texture, texture_array.view);
+    if (texture_array.sampler == nullptr) {
+        texture_array.sampler = init_sampler(webgpu);
+    }
+    binding.group = init_texture_group(webgpu, atlas.texture_layout, texture_array.view,
+                                       texture_array.sampler);
+
+    for (uint32_t i = 0; i < images.size(); i++) {
+        images[i].set<TextureArrayIndex>(array, {i});
+        const ImageData &data = images[i].get<ImageData>();
+        write_texture(webgpu, texture_array.texture, 0, 0, i, data.width, data.height,
+                      data.data);
+    }
+    array.remove<ArrayDirty>();
+}
+
+static void pack_images(flecs::world &world, WGPU &webgpu, Atlas &atlas,
+                        const AtlasSettings &settings, AtlasStats &stats) {
+    if (atlas.page_size != settings.page_size) {
+        world.remove_all<AtlasRegion>();
+        atlas.pages.clear();
+        atlas.release_texture();
+        atlas.page_size = settings.page_size;
+    }
+
+    std::vector<flecs::entity> &uploads = atlas.uploads;
+    uploads.clear();
+
+    // Repack at most one page per frame
+    uint64_t page_area = (uint64_t)atlas.page_size * atlas.page_size;
+    for (uint32_t page = 0; page < atlas.pages.size(); page++) {
+        if (atlas.pages[page].freed_area > settings.repack_waste * page_area) {
+            repack_page(atlas, page);
+            stats.repacked_pages++;
+            break;
+        }
+    }
+
+    std::vector<flecs::entity> &pending = atlas.pending_images;
+    pending.clear();
+    atlas.pending.each([&](flecs::entity e, const ImageData &) { pending.push_back(e); });
+    std::sort(pending.begin(), pending.end(), [](flecs::entity a, flecs::entity b) {
+        return a.get<ImageData>().height > b.get<ImageData>().height;
+    });
+
+    uint32_t max_size = std::min(settings.max_image_size, atlas.page_size - 2 * atlas_padding);
+    for (flecs::entity e : pending) {
+        const ImageData &data = e.get<ImageData>();
+        if (data.width == 0 || data.height == 0) {
+            continue;
+        }
+
+        bool packed = false;
+        AtlasRegion region;
+        if (data.width <= max_size && data.height <= max_size) {
+            for (uint32_t page = 0; page < atlas.pages.size() && !packed; page++) {
+                packed = insert_into_page(atlas, page, data, region);
+            }
+            if (!packed && atlas.pages.size() < settings.max_pages) {
+                atlas.pages.emplace_back();
+                atlas.pages.back().packer.reset(atlas.page_size, atlas.page_size);
+                packed = insert_into_page(atlas, (uint32_t)atlas.pages.size() - 1, data, region);
+            }
+        }
+
+        if (packed) {
+            e.set<AtlasRegion>(region);
+            uploads.push_back(e);
+        } else {
+            add_to_array(world, e, data);
+        }
+    }
+
+    // Pages were added, the new texture gets every image again
+    if (atlas.layers != atlas.pages.size()) {
+        atlas.release_texture();
+        if (!atlas.pages.empty()) {
+            atlas.layers = (uint32_t)atlas.pages.size();
+            init_array_texture(webgpu, atlas.page_size, atlas.page_size, atlas.layers,
+                               atlas.texture, atlas.view);
+            atlas.group = init_texture_group(webgpu, atlas.texture_layout, atlas.view,
+                                             atlas.sampler);
+            uploads.clear();
+            atlas.packed.each([&](flecs::entity e, const ImageData &, const AtlasRegion &) {
+                uploads.push_back(e);
+            });
+        }
+    }
+    for (flecs::entity e : uploads) {
+        upload_region(webgpu, atlas, e.get<ImageData>(), e.get<AtlasRegion>());
+    }
+
+    std::vector<flecs::entity> &dirty = atlas.rebuilt_arrays;
+    dirty.clear();
+    atlas.dirty_arrays.each([&](flecs::entity array) { dirty.push_back(array); });
+    for (flecs::entity array : dirty) {
+        rebuild_array(world, webgpu, atlas, array);
+    }
+
+    stats.pages = (uint32_t)atlas.pages.size();
+    stats.images = (uint32_t)atlas.packed.count();
+    for (auto &[key, entity] : world.ensure<TextureArrayCache>().map) {
+        if (const TextureArray *texture_array = world.entity(entity).try_get<TextureArray>()) {
+            stats.arrays++;
+            stats.array_images += texture_array->count;
+        }
+    }
+}
+
+module::module(flecs::world &world) {
+    WGPU &webgpu = world.ensure<WGPU>();
+    auto instance_layout = init_storage_layout(webgpu, wgpu::ShaderStage::Vertex,
+                                               "Sprite Instance Bind Group Layout");
+    auto texture_layout = init_texture_layout(webgpu);
+    auto &uniform_layout = world.entity<Uniforms>().get<BindingLayout>().layout.value();
+
+    world.component<Image>().member<std::string>("path");
+    world.component<AtlasRegion>()
+        .member<uint32_t>("page")
+        .member<uint32_t>("x")
+        .member<uint32_t>("y")
+        .member<uint32_t>("width")
+        .member<uint32_t>("height");
+    world.component<AtlasSettings>()
+        .member<uint32_t>("page_size")
+        .member<uint32_t>("max_pages")
+        .member<uint32_t>("max_image_size")
+        .member<float>("repack_waste");
+    world.component<AtlasStats>()
+        .member<uint32_t>("pages")
+        .member<uint32_t>("images")
+        .member<uint32_t>("array_images")
+        .member<uint32_t>("arrays")
+        .member<uint32_t>("repacked_pages")
+        .member<uint32_t>("sprites")
+        .member<uint32_t>("draws");
+    world.ensure<AtlasSettings>();
+    world.set<AtlasStats>({});
+    world.ensure<TextureArrayCache>();
+    world.component<Atlas>().on_remove(&Atlas::on_remove);
+
+    Atlas atlas;
+    atlas.texture_layout = texture_layout;
+    atlas.sampler = init_sampler(webgpu);
+    atlas.pending = world.query_builder<const ImageData>()
+                        .with<Image>()
+                        .without<AtlasRegion>()
+                        .without<TextureArrayIndex>(flecs::Wildcard)
+                        .cached()
+                        .build();
+    atlas.packed = world.query_builder<const ImageData, const AtlasRegion>().cached().build();
+    atlas.dirty_arrays = world.query_builder<>().with<ArrayDirty>().build();
+    atlas.array_images = world.query_builder<const ImageData>()
+                             .with<TextureArrayIndex>(flecs::Wildcard)
+                             .cached()
+                             .build();
+    world.set<Atlas>(std::move(atlas));
+
+    // Load the file, the image is packed again during the next Prepare
+    world.observer<const Image>().event(flecs::OnSet).each([](flecs::entity e,
+                                                               const Image &image) {
+        e.remove<AtlasRegion>();
+        e.remove<TextureArrayIndex>(flecs::Wildcard);
+        e.remove<ImageData>();
+
+        int width, height, channels;
+        unsigned char *data = stbi_load(image.path.c_str(), &width, &height, &channels, 4);
+        if (data == nullptr) {
+            std::cerr << "Could not load image: " << image.path << std::endl;
+            return;
+        }
+        e.set<ImageData>({(uint32_t)width, (uint32_t)height, data});
+    });
+
+    // Free the space of removed images, pages are packed again once enough of them is wasted
+    world.observer<const AtlasRegion>().event(flecs::OnRemove).each([](flecs::entity e,
+                                                                       const AtlasRegion &region) {
+        Atlas *atlas = e.world().try_get_mut<Atlas>();
+        if (atlas != nullptr && region.page < atlas->pages.size()) {
+            atlas->pages[region.page].freed_area += padded_area(region.width, region.height);
+        }
+    });
+
+    world.observer()
+        .with<TextureArrayIndex>(flecs::Wildcard)
+        .event(flecs::OnRemove)
+        .each([](flecs::iter &it, size_t) {
+            flecs::entity array = it.pair(0).second();
+            if (array.is_alive()) {
+                array.add<ArrayDirty>();
+            }
+        });
+
+    // Runs outside of deferred mode so regions set while packing are visible right away
+    world.system("sprite_pipeline::Pack")
+        .kind<RenderSystems::Prepare>()
+        .immediate()
+        .run([](flecs::iter &it) {
+            flecs::world world = it.world();
+            AtlasStats &stats = world.get_mut<AtlasStats>();
+            stats = {};
+            pack_images(world, world.get_mut<WGPU>(), world.get_mut<Atlas>(),
+                        world.get<AtlasSettings>(), stats);
+        });
+
+    world.singleton<SpriteInstanceBuffer>()
+        .add<SpriteInstanceBuffer>()
+        // Cast required for emscripten
+        .set<Buffer>(
+            {(wgpu::BufferUsage::W)(wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst)})
+        .set<BindingLayout>({instance_layout})
+        .add<Binding>()
+        .set<SpriteInstances>({
+            world.query_builder<const Quad, const Position, const Color *, const Layer *>()
+                .with<RenderTexture>(flecs::Wildcard)
+                .cached()
+                .build(),
+        });
+
+    // Update buffer, sprites are sorted by layer and then by texture so every run of sprites
+    // sharing a texture is a single draw
+    world.system<WGPU, const Atlas, AtlasStats, Buffer, Binding, BindingLayout, SpriteInstances>()
+        .term_at(0)
+        .singleton()
+        .term_at(1)
+        .singleton()
+        .term_at(2)
+        .singleton()
+        .with<SpriteInstanceBuffer>()
+        .kind<RenderSystems::Prepare>()
+        .each([](flecs::entity e, WGPU &webgpu, const Atlas &atlas, AtlasStats &stats,
+                 Buffer &buffer, Binding &binding, BindingLayout &layout,
+                 SpriteInstances &instances) {
+            std::vector<SpriteRow> &rows = instances.rows;
+            rows.clear();
+
+            float inverse_page = atlas.page_size > 0 ? 1.0f / atlas.page_size : 0.0f;
+            instances.sprites.run([&](flecs::iter &it) {
+                while (it.next()) {
+                    flecs::entity image = it.pair(4).second();
+                    flecs::entity_t texture = 0;
+                    uint32_t texture_layer = 0;
+                    std::array<float, 4> uv = {0.0f, 0.0f, 1.0f, 1.0f};
+                    if (const AtlasRegion *region = image.try_get<AtlasRegion>()) {
+                        texture_layer = region->page;
+                        uv = {region->x * inverse_page, region->y * inverse_page,
+                              (region->x + region->width) * inverse_page,
+                              (region->y + region->height) * inverse_page};
+                    } else if (flecs::entity array = image.target<TextureArrayIndex>()) {
+                        const TextureArrayIndex &index = image.get<TextureArrayIndex>(array);
+                        if (index.index == UINT32_MAX) {
+                            continue;
+                        }
+                        texture = array;
+                        texture_layer = index.index;
+                    } else {
+                        // Not loaded or not packed yet
+                        continue;
+                    }
+
+                    auto quads = it.field<const Quad>(0);
+                    auto positions = it.field<const Position>(1);
+                    for (auto i : it) {
+                        SpriteRow row;
+                        row.layer = it.is_set(3) ? it.field_at<const Layer>(3, i).value : 0.0f;
+                        row.texture = texture;
+                        row.data.color = it.is_set(2) ? it.field_at<const Color>(2, i).color
+                                                      : std::array<float, 4>{1, 1, 1, 1};
+                        row.data.uv = uv;
+                        row.data.position = {positions[i].x, positions[i].y,
+                                             positions[i].rotation, row.layer};
+                        row.data.size = {quads[i].width, quads[i].height};
+                        row.data.texture_layer = texture_layer;
+                        row.data.id = (uint32_t)it.entity(i);
+                        rows.push_back(row);
+                    }
+                }
+            });
+
+            // Row order breaks ties, sprites of one layer and texture keep their query order
+            flecs::world world = e.world();
+            FrameVector<SpriteKey> keys{frame_arena(world)};
+            keys.reserve(rows.size());
+            for (uint32_t i = 0; i < rows.size(); i++) {
+                keys.push_back({rows[i].layer, rows[i].texture, i});
+            }
+            std::sort(keys.begin(), keys.end(), [](const SpriteKey &a, const SpriteKey &b) {
+                if (a.layer != b.layer) {
+                    return a.layer < b.layer;
+                }
+                if (a.texture != b.texture) {
+                    return a.texture < b.texture;
+                }
+                return a.row < b.row;
+            });
+
+            instances.data.clear();
+            instances.batches.clear();
+            for (const SpriteKey &key : keys) {
+                if (instances.batches.empty() || instances.batches.back().texture != key.texture) {
+                    instances.batches.push_back({key.texture, (uint32_t)instances.data.size(), 0});
+                }
+                instances.batches.back().count++;
+                instances.data.push_back(rows[key.row].data);
+            }
+            stats.sprites = (uint32_t)instances.data.size();
+            stats.draws = (uint32_t)instances.batches.size();
+            if (instances.data.empty()) {
+                return;
+            }
+
+            if (buffer.buffer == nullptr || buffer.count < instances.data.size()) {
+                size_t capacity = std::max(buffer.count, (size_t)256);
+                while (capacity < instances.data.size()) {
+                    capacity *= 2;
+                }
+                destroy_buffer(buffer.buffer);
+                buffer.count = capacity;
+                buffer.item_size = sizeof(SpriteData);
+                buffer.init_buffer(webgpu, capacity * sizeof(SpriteData));
+                buffer.update_bind_group(webgpu, binding, layout);
+            }
+            webgpu.queue.writeBuffer(buffer.buffer, 0, instances.data.data(),
+                                     instances.data.size() * sizeof(SpriteData));
+        });
+
+    // Run pipeline
+    auto render = [](flecs::world &world, wgpu::RenderPassEncoder pass) {
+        auto &instances = world.entity<SpriteInstanceBuffer>().get<SpriteInstances>();
+        if (instances.batches.empty()) {
+            return;
+        }
+
+        auto pipeline = world.entity<SpritePipeline>();
+        auto render_pipeline = pipeline.get_mut<RenderPipeline>();
+        pass.setPipeline(render_pipeline.pipeline);
+        pipeline.each<Binds>([&](flecs::entity target) {
+            auto binding = pipeline.get<Binds>(target);
+            auto bind_group = target.get<Binding>();
+            pass.setBindGroup((uint32_t)binding.index, bind_group.group, 0, nullptr);
+        });
+
+        const Atlas &atlas = world.get<Atlas>();
+        for (auto &batch : instances.batches) {
+            wgpu::BindGroup group = atlas.group;
+            if (batch.texture != 0) {
+                const Binding *binding = world.entity(batch.texture).try_get<Binding>();
+                group = binding != nullptr ? binding->group : nullptr;
+            }
+            if (group == nullptr) {
+                continue;
+            }
+            pass.setBindGroup(2, group, 0, nullptr);
+            // Corners are generated from the vertex index as a 4 vertex strip
+            pass.draw(4, batch.count, 0, batch.first);
+        }
+    };
+
+    // The pipeline releases its group layouts when removed
+#ifndef EMSCRIPTEN
+    uniform_layout.addRef();
+    instance_layout.addRef();
+    texture_layout.addRef();
+#else
+    uniform_layout.reference();
+    instance_layout.reference();
+    texture_layout.reference();
+#endif
+    world.singleton<SpritePipeline>()
+        .set<Binds, Uniforms>({0})
+        .set<Binds, SpriteInstanceBuffer>({1})
+        .set<Shader>({ASSET_DIR "/shaders/sprite.wgsl"})
+        .set<RenderPipeline>({{},
+                              {uniform_layout, instance_layout, texture_layout},
+                              wgpu::PrimitiveTopology::TriangleStrip})
+        .set<RenderFunction>({render});
+}
+
+} // namespace sprite_pipeline
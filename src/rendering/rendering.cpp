@@ -1,4 +1,6 @@
 #include "../include.hpp"
+#include "commands.hpp"
+#include "graph.hpp"
 #include "pipelines/pipelines.hpp"
 #include "types/types.hpp"
 #include "stb_image.h"
@@ -45,7 +47,82 @@ void device_lost(WGPUDeviceLostReason reason, char const *message, void * /* pUs
 }
 #endif
 
-static WGPU init_webgpu(Window &window) {
+static void resolve_picking(void *world_ptr, bool success) {
+    flecs::world world{(flecs::world_t *)world_ptr};
+    // The target is removed when settings disable picking, which aborts the pending map
+    auto *picking = world.try_get_mut<PickingTarget>();
+    if (picking == nullptr) {
+        return;
+    }
+    picking->pending = false;
+    if (!success) {
+        return;
+    }
+
+    uint32_t id = *(const uint32_t *)picking->readback.getConstMappedRange(0, sizeof(uint32_t));
+    picking->readback.unmap();
+
+    // Only the entity index is written to the id target, look up the live generation
+    world.get_mut<Hovered>().entity = id != 0 ? (flecs::entity_t)world.get_alive(id) : 0;
+}
+
+#ifndef EMSCRIPTEN
+void picking_mapped(WGPUMapAsyncStatus status, WGPUStringView /* message */, void *world_ptr,
+                    void * /* pUserData */) {
+    resolve_picking(world_ptr, status == WGPUMapAsyncStatus_Success);
+}
+#else
+void picking_mapped(WGPUBufferMapAsyncStatus status, void *world_ptr) {
+    resolve_picking(world_ptr, status == WGPUBufferMapAsyncStatus_Success);
+}
+#endif
+
+static void map_picking(PickingTarget &picking, void *world_ptr) {
+    picking.pending = true;
+#ifndef EMSCRIPTEN
+    WGPUBufferMapCallbackInfo callback_info = {};
+    callback_info.mode = WGPUCallbackMode_AllowSpontaneous;
+    callback_info.callback = &picking_mapped;
+    callback_info.userdata1 = world_ptr;
+    wgpuBufferMapAsync(picking.readback, WGPUMapMode_Read, 0, sizeof(uint32_t), callback_info);
+#else
+    wgpuBufferMapAsync(picking.readback, WGPUMapMode_Read, 0, sizeof(uint32_t), &picking_mapped,
+                       world_ptr);
+#endif
+}
+
+// Copy the id under the cursor into the readback buffer, returns false if there is nothing to read
+static bool copy_picking(CommandEncoder encoder, PickingTarget &picking, const Cursor &cursor) {
+    if (cursor.pixel_x < 0 || cursor.pixel_y < 0 ||
+        (uint32_t)cursor.pixel_x >= picking.target.width ||
+        (uint32_t)cursor.pixel_y >= picking.target.height) {
+        return false;
+    }
+
+#ifndef EMSCRIPTEN
+    TexelCopyTextureInfo source;
+    TexelCopyBufferInfo destination;
+#else
+    ImageCopyTexture source;
+    ImageCopyBuffer destination;
+#endif
+    source.texture = picking.target.texture;
+    source.mipLevel = 0;
+    source.origin.x = (uint32_t)cursor.pixel_x;
+    source.origin.y = (uint32_t)cursor.pixel_y;
+    source.origin.z = 0;
+    source.aspect = TextureAspect::All;
+
+    destination.buffer = picking.readback;
+    destination.layout.offset = 0;
+    destination.layout.bytesPerRow = PickingTarget::readback_size;
+    destination.layout.rowsPerImage = 1;
+
+    encoder.copyTextureToBuffer(source, destination, {1, 1, 1});
+    return true;
+}
+
+static WGPU init_webgpu(Window &window, const Settings &settings) {
     // Initialize WebGPU
     InstanceDescriptor desc = {};
     desc.nextInChain = nullptr;
@@ -57,9 +134,6 @@ static WGPU init_webgpu(Window &window) {
         return {};
     }
 
-    // or surface.getPreferredFormat()
-    TextureFormat format = TextureFormat::BGRA8Unorm;
-
     Surface surface = glfwCreateWindowWGPUSurface(instance, window.ptr);
     window.surface = surface;
 
@@ -91,6 +165,15 @@ static WGPU init_webgpu(Window &window) {
     Device device = adapter.requestDevice(device_desc);
     Queue queue = device.getQueue();
 
+    WGPU webgpu{adapter, device, instance, queue, wgpu::Color{0.4, 0.4, 0.4, 1.0}};
+    configure_surface(webgpu, window, settings);
+    return webgpu;
+}
+
+void configure_surface(WGPU &webgpu, Window &window, const Settings &settings) {
+    // or surface.getPreferredFormat()
+    TextureFormat format = TextureFormat::BGRA8Unorm;
+
     SurfaceConfiguration config = {};
     config.nextInChain = nullptr;
     config.width = window.width;
@@ -99,12 +182,150 @@ static WGPU init_webgpu(Window &window) {
     config.viewFormatCount = 0;
     config.viewFormats = nullptr;
     config.usage = TextureUsage::RenderAttachment;
-    config.device = device;
-    config.presentMode = PresentMode::Fifo;
+    config.device = webgpu.device;
+    config.presentMode = settings.vsync ? PresentMode::Fifo : PresentMode::Immediate;
     config.alphaMode = WGPUCompositeAlphaMode_Auto;
-    surface.configure(config);
+    window.surface.configure(config);
+}
 
-    return {adapter, device, instance, queue, wgpu::Color{0.4, 0.4, 0.4, 1.0}};
+void resize_targets(flecs::world &world, uint32_t width, uint32_t height) {
+    auto &webgpu = world.ensure<WGPU>();
+    if (auto *picking = world.try_get_mut<PickingTarget>()) {
+        picking->resize(webgpu, width, height);
+        world.entity<PickingTarget>().set<ImportedTexture>({picking->target.view});
+    }
+    if (auto *multisample = world.try_get_mut<MultisampleTarget>()) {
+        multisample->target.resize(webgpu, width, height);
+        world.entity<MultisampleTarget>().set<ImportedTexture>({multisample->target.view});
+    }
+    if (auto *depth = world.try_get_mut<DepthTarget>()) {
+        depth->target.resize(webgpu, width, height);
+        world.entity<DepthTarget>().set<ImportedTexture>({depth->target.view});
+    }
+}
+
+// Create or remove the optional render targets to match the settings. Their views are imported
+// into the graph until the next resize, targets that were removed have none.
+static void init_targets(flecs::world &world, const Settings &settings) {
+    auto &webgpu = world.ensure<WGPU>();
+    auto &window = world.ensure<Window>();
+
+    if (settings.use_picking() && !world.has<PickingTarget>()) {
+        PickingTarget picking;
+        picking.resize(webgpu, window.width, window.height);
+        world.entity<PickingTarget>().set<ImportedTexture>({picking.target.view});
+        world.set<PickingTarget>(std::move(picking));
+    } else if (!settings.use_picking()) {
+        world.remove<PickingTarget>();
+        world.entity<PickingTarget>().remove<ImportedTexture>();
+        world.set<Hovered>({});
+    }
+
+    if (settings.sample_count() > 1 && !world.has<MultisampleTarget>()) {
+        MultisampleTarget multisample;
+        multisample.target.sample_count = settings.sample_count();
+        multisample.target.resize(webgpu, window.width, window.height);
+        world.entity<MultisampleTarget>().set<ImportedTexture>({multisample.target.view});
+        world.set<MultisampleTarget>(std::move(multisample));
+    } else if (settings.sample_count() == 1) {
+        world.remove<MultisampleTarget>();
+        world.entity<MultisampleTarget>().remove<ImportedTexture>();
+    }
+
+    // The depth target must match the sample count of the color target
+    const DepthTarget *depth = world.try_get<DepthTarget>();
+    if (!settings.use_depth() ||
+        (depth != nullptr && depth->target.sample_count != settings.sample_count())) {
+        world.remove<DepthTarget>();
+        world.entity<DepthTarget>().remove<ImportedTexture>();
+        depth = nullptr;
+    }
+    if (settings.use_depth() && depth == nullptr) {
+        DepthTarget target;
+        target.target.sample_count = settings.sample_count();
+        target.target.resize(webgpu, window.width, window.height);
+        world.entity<DepthTarget>().set<ImportedTexture>({target.target.view});
+        world.set<DepthTarget>(std::move(target));
+    }
+}
+
+// RenderFunction pipelines a pass draws
+struct PassDraws {
+    flecs::query<const RenderFunction> render_functions;
+};
+
+static void draw_render_functions(PassContext &context) {
+    context.pass.get<PassDraws>().render_functions.each(
+        [&](const RenderFunction &func) { func.fn(context.world, context.render); });
+}
+
+// Clears the surface, or the scene color while bloom is on, and draws every RenderFunction that
+// isn't an overlay, reading the resources their pipelines bind. The overlay pass draws the rest
+// into the same attachments, which the graph merges into the main render pass. Attachments follow
+// the settings, so they match the targets init_targets creates.
+static void declare_main_passes(flecs::world &world, const Settings &settings) {
+    GraphPass pass;
+    pass.draws_render_functions = true;
+    pass.execute = draw_render_functions;
+
+    flecs::entity_t output = settings.bloom > 0.0f ? world.entity<SceneColor>().id()
+                                                   : world.entity<SurfaceTarget>().id();
+    Attachment color;
+    color.resource = output;
+    color.clear = world.get<WGPU>().clear_color;
+    // Render into the multisampled target and resolve into the output
+    if (settings.sample_count() > 1) {
+        color.resource = world.entity<MultisampleTarget>();
+        color.resolve = output;
+    }
+    pass.colors.push_back(color);
+
+    if (settings.use_picking()) {
+        Attachment id;
+        id.resource = world.entity<PickingTarget>();
+        pass.colors.push_back(id);
+    }
+
+    // Cleared to the far plane
+    if (settings.use_depth()) {
+        pass.depth.resource = world.entity<DepthTarget>();
+    }
+
+    // Multisampled color and depth are only needed until the overlays are drawn
+    GraphPass overlay = pass;
+    overlay.order = 1;
+    for (Attachment &attachment : overlay.colors) {
+        attachment.load = LoadOp::Load;
+    }
+    if (settings.sample_count() > 1) {
+        overlay.colors[0].store = StoreOp::Discard;
+    }
+    overlay.depth.load = LoadOp::Load;
+    overlay.depth.store = StoreOp::Discard;
+
+    world.entity<MainPass>().set<GraphPass>(std::move(pass));
+    world.entity<OverlayPass>().set<GraphPass>(std::move(overlay));
+}
+
+// Recreate every render pipeline, picking up target and anti-aliasing changes
+static void rebuild_pipelines(flecs::world &world) {
+    world.defer([&] {
+        world.each([](flecs::entity e, RenderPipeline &pipeline, Shader &shader) {
+            if (!e.has<Ready>()) {
+                return;
+            }
+            if (pipeline.pipeline != nullptr) {
+                pipeline.pipeline.release();
+                pipeline.pipeline = nullptr;
+            }
+            if (shader.module != nullptr) {
+                shader.module.release();
+                shader.module = nullptr;
+            }
+            e.remove<Ready>();
+            e.modified<RenderPipeline>();
+        });
+    });
 }
 
 static BindGroupLayout init_uniform_bind_group_layout(WGPU &webgpu) {
@@ -134,6 +355,9 @@ module::module(flecs::world &world) {
     world.component<Binding>().on_remove(&Binding::on_remove);
     world.component<TextureArray>().on_remove(&TextureArray::on_remove);
     world.component<Window>().on_remove(&Window::on_remove);
+    world.component<PickingTarget>().on_remove(&PickingTarget::on_remove);
+    world.component<MultisampleTarget>().on_remove(&MultisampleTarget::on_remove);
+    world.component<DepthTarget>().on_remove(&DepthTarget::on_remove);
 
     world.component<RenderTexture>().add(flecs::Traversable);
 
@@ -152,7 +376,9 @@ module::module(flecs::world &world) {
     world.import <window::module>();
 
     auto &window = world.ensure<Window>();
-    WGPU webgpu_instance = init_webgpu(window);
+    // Keep settings set before import, pipelines read them when they are created
+    auto &settings = world.ensure<Settings>();
+    WGPU webgpu_instance = init_webgpu(window, settings);
 
     if (webgpu_instance.instance == nullptr) {
         std::cerr << "Could not initialize WebGPU!" << std::endl;
@@ -161,12 +387,29 @@ module::module(flecs::world &world) {
     }
 
     world.set<WGPU>(std::move(webgpu_instance));
-    world.pipeline<MainPass>().with(flecs::System).with<MainPass>().build();
 
     world.import <types::module>();
+    world.import <render_graph::module>();
 
     auto &webgpu = world.ensure<WGPU>();
 
+    world.set<Hovered>({});
+    init_targets(world, world.get<Settings>());
+    world.entity<SceneColor>().set<TransientTexture>({});
+    world.entity<MainPass>().set<PassDraws>(
+        {world.query_builder<const RenderFunction>().without<Overlay>().cached().build()});
+    world.entity<OverlayPass>().set<PassDraws>(
+        {world.query_builder<const RenderFunction>().with<Overlay>().cached().build()});
+    declare_main_passes(world, world.get<Settings>());
+
+    world.observer<Settings>().event(flecs::OnSet).each([](flecs::entity e, Settings &settings) {
+        flecs::world world = e.world();
+        configure_surface(world.ensure<WGPU>(), world.ensure<Window>(), settings);
+        init_targets(world, settings);
+        declare_main_passes(world, settings);
+        rebuild_pipelines(world);
+    });
+
     auto layout = init_uniform_bind_group_layout(webgpu);
     world
         .component<Uniforms>()
@@ -175,51 +418,98 @@ module::module(flecs::world &world) {
         .set<BindingLayout>({layout})
         .set<Binding>({});
     world.set<Uniforms>({{(float)window.width, (float)window.height}});
-    world.set<Encoder>({});
 
-    world.import <pipelines::module>();
+    world.component<CommandEncoders>().on_remove(&CommandEncoders::on_remove);
+    world.component<CommandStats>().member<uint32_t>("command_buffers");
+    world.set<CommandStats>({});
+    CommandEncoders encoders;
+    encoders.stages.resize(world.get_stage_count());
+    world.set<CommandEncoders>(std::move(encoders));
+
+    world.component<GpuMemoryUsage>().member<uint64_t>("bytes").member<uint64_t>("peak");
+    world.component<GpuMemoryStats>()
+        .member<GpuMemoryUsage>("instances")
+        .member<GpuMemoryUsage>("vertices")
+        .member<GpuMemoryUsage>("uniforms")
+        .member<GpuMemoryUsage>("textures")
+        .member<GpuMemoryUsage>("staging")
+        .member<GpuMemoryUsage>("total");
+    world.component<GpuMemoryBudget>().member<uint64_t>("bytes");
+    world.set<GpuMemoryStats>({});
+    world.ensure<GpuMemoryBudget>();
+
+    FrameArena arena;
+    arena.stages.resize(world.get_stage_count());
+    world.set<FrameArena>(std::move(arena));
 
-    // Instantiate command encoder
-    world.system<WGPU>().kind<RenderSystems::Initialize>().each([](flecs::entity e, WGPU &webgpu) {
-        CommandEncoderDescriptor command_encoder_desc;
-        command_encoder_desc.label = toWgpuStringView("Command Encoder");
-        CommandEncoder encoder = webgpu.device.createCommandEncoder(command_encoder_desc);
+    world.import <pipelines::module>();
 
-        e.world().set<Encoder>({encoder});
+    // Release transient data of the previous frame
+    world.system<FrameArena>().kind<RenderSystems::Load>().each([](flecs::entity e,
+                                                                   FrameArena &arena) {
+        // Pick up thread count changes while no other stage is allocating
+        arena.stages.resize(e.world().get_stage_count());
+        for (auto &stage : arena.stages) {
+            stage.reset();
+        }
     });
 
+    // Publish GPU memory usage, warn when the budget is first exceeded
+    world.system<GpuMemoryStats, const GpuMemoryBudget>()
+        .term_at(0)
+        .singleton()
+        .term_at(1)
+        .singleton()
+        .kind<RenderSystems::Load>()
+        .each([](GpuMemoryStats &stats, const GpuMemoryBudget &budget) {
+            uint64_t previous = stats.total.bytes;
+            stats = gpu_memory_stats();
+            if (budget.bytes > 0 && stats.total.bytes > budget.bytes &&
+                previous <= budget.bytes) {
+                std::cerr << "GPU memory budget exceeded: " << stats.total.bytes << " of "
+                          << budget.bytes << " bytes (textures " << stats.textures.bytes
+                          << ", instances " << stats.instances.bytes << ", vertices "
+                          << stats.vertices.bytes << ")" << std::endl;
+            }
+        });
+
     // Prepare uniforms
     world.system<WGPU>().kind<RenderSystems::Prepare>().each([](flecs::entity e, WGPU &webgpu) {
         e.world().entity<Uniforms>().get(
             [&](Buffer &buffer, BindingLayout &layout, Binding &binding, Uniforms &data) {
+                if (const Camera *camera = e.world().try_get<Camera>()) {
+                    data.camera = {camera->x, camera->y};
+                }
                 buffer.write_buffer(webgpu, data);
                 buffer.update_bind_group(webgpu, binding, layout);
             });
     });
 
-    // Render main pass
-    world.system<WGPU, Encoder, Window>()
+    // Execute the render graph into the surface
+    world.system<WGPU, Window>()
         .term_at(0)
         .singleton()
         .term_at(1)
         .singleton()
         .kind<RenderSystems::Queue>()
-        .each([](flecs::entity e, WGPU &webgpu, Encoder &encoder, Window &window) {
+        .each([](flecs::entity e, WGPU &webgpu, Window &window) {
             SurfaceTexture surface_texture;
             window.surface.getCurrentTexture(&surface_texture);
+            flecs::world world{e.world()};
 
 #ifndef EMSCRIPTEN
             if (surface_texture.status != WGPUSurfaceGetCurrentTextureStatus_SuccessOptimal) {
+                // Work recorded outside the graph doesn't depend on the surface
+                submit_commands(world);
                 return;
             }
 #else
             if (surface_texture.status != WGPUSurfaceGetCurrentTextureStatus_Success) {
+                submit_commands(world);
                 return;
             }
 #endif
 
-            flecs::world world{e.world()};
-
             TextureViewDescriptor view_desc;
             view_desc.nextInChain = nullptr;
             view_desc.label = toWgpuStringView("Surface texture view");
@@ -232,40 +522,31 @@ module::module(flecs::world &world) {
             view_desc.aspect = WGPUTextureAspect_All;
             TextureView texture_view = wgpuTextureCreateView(surface_texture.texture, &view_desc);
 
-            RenderPassDescriptor render_pass_desc;
-
-            RenderPassColorAttachment render_pass_color_attachment;
-            render_pass_color_attachment.view = texture_view;
-            render_pass_color_attachment.resolveTarget = nullptr;
-            render_pass_color_attachment.loadOp = LoadOp::Clear;
-            render_pass_color_attachment.storeOp = StoreOp::Store;
-            render_pass_color_attachment.clearValue = webgpu.clear_color;
-            render_pass_desc.colorAttachmentCount = 1;
-            render_pass_desc.colorAttachments = &render_pass_color_attachment;
-
-            render_pass_desc.depthStencilAttachment = nullptr;
-            render_pass_desc.timestampWrites = nullptr;
-            RenderPassEncoder render_pass = encoder.ptr.beginRenderPass(render_pass_desc);
-
-            world.each([=](flecs::entity e, RenderFunction &func) {
-                flecs::world world{e.world()};
-                func.fn(world, render_pass);
-            });
-
-            render_pass.end();
-            render_pass.release();
+            GraphImports imports{frame_arena(world)};
+            imports.push_back({world.entity<SurfaceTarget>(), texture_view});
+            CommandEncoder encoder = command_encoder(world, SubmitGraph);
+            execute_graph(world, encoder, imports);
             texture_view.release();
 
-            CommandBufferDescriptor command_buffer_descriptor;
-            command_buffer_descriptor.label = toWgpuStringView("Command buffer");
-            CommandBuffer command = encoder.ptr.finish(command_buffer_descriptor);
-            webgpu.queue.submit(command);
-            encoder.ptr.release();
+            // Read back the id under the cursor, resolved a frame later once the map completes
+            bool read_picking = false;
+            PickingTarget *picking = world.try_get_mut<PickingTarget>();
+            const Cursor *cursor = world.try_get<Cursor>();
+            if (picking != nullptr && picking->target.view != nullptr && !picking->pending &&
+                cursor != nullptr) {
+                read_picking = copy_picking(command_encoder(world, SubmitReadback), *picking,
+                                            *cursor);
+            }
+
+            submit_commands(world);
 
 #ifndef __EMSCRIPTEN__
             window.surface.present();
 #endif
-            command.release();
+
+            if (read_picking) {
+                map_picking(*picking, (void *)ecs_get_world(world));
+            }
 
 #if defined(WEBGPU_BACKEND_DAWN)
             webgpu.device.tick();
@@ -4,9 +4,12 @@
 #include <array>
 #include <filesystem>
 #include <optional>
+#include <string>
 #include "webgpu/webgpu.hpp"
 #include <GLFW/glfw3.h>
 #include "stb_image.h"
+#include "../common.hpp"
+#include "memory.hpp"
 
 namespace rendering {
 
@@ -14,6 +17,8 @@ struct Ready {};
 
 struct Uniforms {
     std::array<float, 2> viewport;
+    // Copied from the Camera singleton every frame
+    std::array<float, 2> camera = {0.0f, 0.0f};
 };
 
 struct WGPU {
@@ -30,15 +35,146 @@ struct WGPU {
     }
 };
 
-struct Encoder {
-    wgpu::CommandEncoder ptr = nullptr;
+enum class AntiAliasing : uint8_t {
+    None,     // Hard SDF edges, fragments outside the shape are discarded
+    Msaa4x,   // 4x multisampled main pass resolved into the surface
+    Analytic, // SDF coverage from screen space derivatives, no discard
+};
+
+// Renderer configuration. Set before importing the rendering module to override the defaults,
+// setting it afterwards recreates the render targets and pipelines.
+struct Settings {
+    // Write entity ids to a second main pass target so the entity under the cursor can be read
+    // back. Integer targets can't be resolved, so picking is unavailable with MSAA.
+    bool picking = true;
+    AntiAliasing anti_aliasing = AntiAliasing::None;
+    bool vsync = true;
+    // Draw opaque shapes front to back against a depth target before blending the rest back to
+    // front. Analytic edges are blended and can't write depth, so with analytic anti-aliasing
+    // every shape is blended in layer order without a depth target.
+    bool depth = true;
+    // Strength of the glow added around bright pixels. Above zero the main pass draws into an
+    // offscreen target that a post-processing pass composites into the surface.
+    float bloom = 0.0f;
+
+    bool use_picking() const { return picking && anti_aliasing != AntiAliasing::Msaa4x; }
+    bool use_depth() const { return depth && anti_aliasing != AntiAliasing::Analytic; }
+    uint32_t sample_count() const { return anti_aliasing == AntiAliasing::Msaa4x ? 4 : 1; }
+};
+
+// Tag for pipelines whose shader declares the ANALYTIC_AA and AA_PADDING override constants
+struct AntiAliased {};
+
+// Tag for pipelines that draw opaque geometry, they write depth and skip blending
+struct DepthWrite {};
+
+// Tag for pipelines drawing things that aren't entities, they use fs_main and leave the id target
+// unwritten so whatever is behind them stays pickable
+struct NotPickable {};
+
+// Tag for RenderFunction pipelines drawn after all others, like debug lines over the shapes
+struct Overlay {};
+
+// Tag for fullscreen pipelines of graph passes other than the main pass. They draw into a single
+// window format target without blending, depth, multisampling or the id target.
+struct PostProcess {};
+
+// Entity under the cursor, resolved from the id target a frame after it was rendered
+struct Hovered {
+    flecs::entity_t entity = 0;
+};
+
+// Window sized texture rendered to by the main pass
+struct RenderTarget {
+    wgpu::TextureFormat format = wgpu::TextureFormat::Undefined;
+    wgpu::TextureUsage usage = wgpu::TextureUsage::RenderAttachment;
+    uint32_t sample_count = 1;
+    wgpu::Texture texture = nullptr;
+    wgpu::TextureView view = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    void release() {
+        if (texture != nullptr) {
+            view.release();
+            destroy_texture(texture);
+            view = nullptr;
+        }
+    }
+
+    void resize(WGPU &webgpu, uint32_t new_width, uint32_t new_height) {
+        release();
+        width = new_width;
+        height = new_height;
+        if (width == 0 || height == 0) {
+            return;
+        }
+
+        wgpu::TextureDescriptor texture_desc;
+        texture_desc.dimension = wgpu::TextureDimension::_2D;
+        texture_desc.format = format;
+        texture_desc.mipLevelCount = 1;
+        texture_desc.sampleCount = sample_count;
+        texture_desc.size = {width, height, 1};
+        texture_desc.usage = usage;
+        texture_desc.viewFormatCount = 0;
+        texture_desc.viewFormats = nullptr;
+        texture = create_texture(webgpu.device, texture_desc);
+        view = texture.createView();
+    }
+};
+
+// Entity id target of the main pass and the staging buffer a single pixel is copied into
+struct PickingTarget {
+    // Texture to buffer copies require rows aligned to 256 bytes
+    static constexpr uint64_t readback_size = 256;
+
+    // Cast required for emscripten
+    RenderTarget target = {
+        wgpu::TextureFormat::R32Uint,
+        (wgpu::TextureUsage::W)(wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc)};
+    wgpu::Buffer readback = nullptr;
+    bool pending = false;
+
+    static void on_remove(PickingTarget &value) {
+        value.target.release();
+        destroy_buffer(value.readback);
+    }
+
+    void resize(WGPU &webgpu, uint32_t width, uint32_t height) {
+        target.resize(webgpu, width, height);
+
+        if (readback == nullptr) {
+            wgpu::BufferDescriptor buffer_desc;
+            buffer_desc.usage =
+                (wgpu::BufferUsage::W)(wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst);
+            buffer_desc.mappedAtCreation = false;
+            buffer_desc.size = readback_size;
+            readback = create_buffer(webgpu.device, buffer_desc);
+        }
+    }
+};
+
+// Multisampled color target resolved into the surface when MSAA is enabled
+struct MultisampleTarget {
+    RenderTarget target = {wgpu::TextureFormat::BGRA8Unorm, wgpu::TextureUsage::RenderAttachment,
+                           4};
+
+    static void on_remove(MultisampleTarget &value) { value.target.release(); }
+};
+
+// Depth target of the main pass, multisampled to match the color target
+struct DepthTarget {
+    RenderTarget target = {wgpu::TextureFormat::Depth24Plus, wgpu::TextureUsage::RenderAttachment};
+
+    static void on_remove(DepthTarget &value) { value.target.release(); }
 };
 
 struct RenderSystems {
     struct Load {};       // Load assets (shaders)
     struct Initialize {}; // Create render resources (pipelines, layouts and buffers)
     struct Prepare {};    // Fill render resources (buffers and bind groups)
-    struct Queue {};      // Run pipelines
+    struct Queue {};      // Execute the render graph
 };
 
 // Tags to associate pipeline with it's resources
@@ -50,7 +186,7 @@ struct Binds {
 
 struct PipelineShader {};
 
-// Relation for texture for a rect to render
+// Relation for texture for a rect to render, the target is an Image entity
 struct RenderTexture {};
 
 struct ImageData {
@@ -61,10 +197,16 @@ struct ImageData {
     static void on_remove(ImageData &value) { stbi_image_free(value.data); }
 };
 
+// Render graph pass that clears the surface, or SceneColor with bloom, and draws the RenderFunction
+// pipelines that aren't overlays
 struct MainPass {};
 
+// Render graph pass drawing the Overlay pipelines into the attachments of the main pass
+struct OverlayPass {};
+
+// Plain function so drawing never allocates, pipelines keep their state in components
 struct RenderFunction {
-    std::function<void(flecs::world &, wgpu::RenderPassEncoder)> fn;
+    void (*fn)(flecs::world &, wgpu::RenderPassEncoder);
 };
 
 // Render resources
@@ -79,10 +221,14 @@ struct VertexBuffer {
     }
 };
 
+// Pipelines without vertex attributes pull their vertices from storage buffers in the shader
 struct RenderPipeline {
     wgpu::VertexBufferLayout vertex_layout;
     std::vector<wgpu::BindGroupLayout> group_layouts;
+    wgpu::PrimitiveTopology topology = wgpu::PrimitiveTopology::TriangleList;
     wgpu::RenderPipeline pipeline = nullptr;
+    // PostProcess pipelines pick their fragment entry point, the others use fs_main or fs_picking
+    std::string fragment_entry_point;
 
     static void on_remove(RenderPipeline &value) {
         if (value.pipeline != nullptr) {
@@ -101,6 +247,8 @@ struct RenderPipeline {
 struct ComputePipeline {
     std::vector<wgpu::BindGroupLayout> group_layouts;
     wgpu::ComputePipeline pipeline = nullptr;
+    // Several pipelines may share one shader through different entry points
+    std::string entry_point = "compute";
 
     static void on_remove(ComputePipeline &value) {
         if (value.pipeline != nullptr) {
@@ -149,19 +297,14 @@ struct Buffer {
     size_t item_size = 0;
     wgpu::Buffer buffer = nullptr;
 
-    static void on_remove(Buffer &value) {
-        if (value.buffer != nullptr) {
-            value.buffer.destroy();
-            value.buffer.release();
-        }
-    }
+    static void on_remove(Buffer &value) { destroy_buffer(value.buffer); }
 
     void init_buffer(WGPU &webgpu, uint64_t size) {
         wgpu::BufferDescriptor buffer_desc;
         buffer_desc.usage = usage;
         buffer_desc.mappedAtCreation = false;
         buffer_desc.size = size;
-        buffer = webgpu.device.createBuffer(buffer_desc);
+        buffer = create_buffer(webgpu.device, buffer_desc);
     }
 
     template <typename T> void write_buffer(WGPU &webgpu, T &data) {
@@ -170,10 +313,10 @@ struct Buffer {
         auto size = count * item_size;
 
         if (buffer != nullptr && buffer.getSize() < size) {
-            buffer.release();
-            init_buffer(webgpu, count * item_size);
-        } else if (buffer == nullptr) {
-            init_buffer(webgpu, count * item_size);
+            destroy_buffer(buffer);
+        }
+        if (buffer == nullptr) {
+            init_buffer(webgpu, size);
         }
 
         webgpu.queue.writeBuffer(buffer, 0, &data, size);
@@ -185,10 +328,10 @@ struct Buffer {
         auto size = count * item_size;
 
         if (buffer != nullptr && buffer.getSize() < size) {
-            buffer.release();
-            init_buffer(webgpu, count * item_size);
-        } else if (buffer == nullptr) {
-            init_buffer(webgpu, count * item_size);
+            destroy_buffer(buffer);
+        }
+        if (buffer == nullptr) {
+            init_buffer(webgpu, size);
         }
 
         webgpu.queue.writeBuffer(buffer, 0, data.data(), size);
@@ -232,9 +375,13 @@ struct TextureArray {
     wgpu::Extent3D &size() { return mip_sizes[0]; }
 
     static void on_remove(TextureArray &value) {
-        value.texture.release();
-        value.view.release();
-        value.sampler.release();
+        if (value.view != nullptr) {
+            value.view.release();
+        }
+        if (value.sampler != nullptr) {
+            value.sampler.release();
+        }
+        destroy_texture(value.texture);
     }
 };
 
@@ -263,6 +410,12 @@ WGPUStringView toWgpuStringView(std::string_view stdStringView);
 const char *toWgpuStringView(std::string_view stdStringView);
 #endif
 
+// Configure the surface for the window size and present mode
+void configure_surface(WGPU &webgpu, Window &window, const Settings &settings);
+
+// Resize every window sized render target
+void resize_targets(flecs::world &world, uint32_t width, uint32_t height);
+
 struct module {
     module(flecs::world &world);
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Portable 4 wide float vector. Uses SSE2 on x86 (and on emscripten builds with -msse2), NEON on
+// ARM and plain arrays everywhere else. Define SIMD_DISABLE to force the scalar implementation.
+#if !defined(SIMD_DISABLE) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64))
+#include <emmintrin.h>
+#define SIMD_SSE
+#elif !defined(SIMD_DISABLE) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define SIMD_NEON
+#else
+#define SIMD_SCALAR
+#endif
+
+namespace simd {
+
+inline float bits_to_float(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Lanes are listed low to high, [x, y, z, w]
+struct float4 {
+#if defined(SIMD_SSE)
+    __m128 v;
+
+    static float4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+    // [p[0], p[1], 0, 0] without reading past the two floats. The integer load has no alignment
+    // requirement and may alias the floats.
+    static float4 load2(const float *p) {
+        return {_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)p))};
+    }
+    // [x, y, 0, 0]
+    static float4 pair(float x, float y) {
+        return {_mm_unpacklo_ps(_mm_set_ss(x), _mm_set_ss(y))};
+    }
+    static float4 broadcast(float x) { return {_mm_set1_ps(x)}; }
+    // [a.x, a.y, b.x, b.y]
+    static float4 combine_low(float4 a, float4 b) { return {_mm_movelh_ps(a.v, b.v)}; }
+    // Stores are unaligned and may alias any type
+    void store(void *p) const { _mm_storeu_ps((float *)p, v); }
+#elif defined(SIMD_NEON)
+    float32x4_t v;
+
+    static float4 load(const float *p) { return {vld1q_f32(p)}; }
+    static float4 load2(const float *p) { return {vcombine_f32(vld1_f32(p), vdup_n_f32(0.0f))}; }
+    static float4 pair(float x, float y) {
+        float32x2_t low = vset_lane_f32(y, vdup_n_f32(x), 1);
+        return {vcombine_f32(low, vdup_n_f32(0.0f))};
+    }
+    static float4 broadcast(float x) { return {vdupq_n_f32(x)}; }
+    static float4 combine_low(float4 a, float4 b) {
+        return {vcombine_f32(vget_low_f32(a.v), vget_low_f32(b.v))};
+    }
+    void store(void *p) const { vst1q_f32((float *)p, v); }
+#else
+    float v[4];
+
+    static float4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+    static float4 load2(const float *p) { return {{p[0], p[1], 0.0f, 0.0f}}; }
+    static float4 pair(float x, float y) { return {{x, y, 0.0f, 0.0f}}; }
+    static float4 broadcast(float x) { return {{x, x, x, x}}; }
+    static float4 combine_low(float4 a, float4 b) { return {{a.v[0], a.v[1], b.v[0], b.v[1]}}; }
+    void store(void *p) const { std::memcpy(p, v, sizeof(v)); }
+#endif
+};
+
+} // namespace simd
@@ -12,14 +12,14 @@ wgpu::Buffer init_buffer(WGPU &webgpu, wgpu::BufferUsage usage) {
     BufferDescriptor buffer_desc;
     buffer_desc.usage = usage;
     buffer_desc.mappedAtCreation = false;
-    return webgpu.device.createBuffer(buffer_desc);
+    return create_buffer(webgpu.device, buffer_desc);
 }
 
 module::module(flecs::world &world) {
     world.component<VertexBuffer>().on_add([](flecs::entity e, VertexBuffer &) {
+        // Sized by the first write
         e.set<Buffer>(
-            {(wgpu::BufferUsage::W)(wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst), 18,
-             sizeof(float)});
+            {(wgpu::BufferUsage::W)(wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst)});
     });
 
     world.observer<WGPU, Buffer>()
@@ -28,8 +28,8 @@ module::module(flecs::world &world) {
         .singleton()
         .without<Ready>()
         .each([](flecs::entity e, WGPU &webgpu, Buffer &buffer) {
-            if (buffer.buffer == nullptr) {
-                buffer.init_buffer(webgpu, 4 * 18);
+            if (buffer.buffer == nullptr && buffer.count > 0) {
+                buffer.init_buffer(webgpu, buffer.count * buffer.item_size);
             }
             e.add<Ready>();
         });
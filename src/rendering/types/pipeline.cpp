@@ -18,26 +18,51 @@ void init_render_pipeline(WGPU &webgpu, flecs::entity e, RenderPipeline &pipelin
     // or surface.getPreferredFormat()
     TextureFormat format = TextureFormat::BGRA8Unorm;
 
+    const Settings &settings = e.world().get<Settings>();
+    bool analytic_aa = settings.anti_aliasing == AntiAliasing::Analytic;
+
+    // Analytic anti-aliasing pads every shape by a pixel so the coverage falloff isn't clipped,
+    // the vertex stage works in half pixel units
+    ConstantEntry padding_constant;
+    padding_constant.key = toWgpuStringView("AA_PADDING");
+    padding_constant.value = analytic_aa ? 2.0 : 0.0;
+
+    ConstantEntry aa_constant;
+    aa_constant.key = toWgpuStringView("ANALYTIC_AA");
+    aa_constant.value = analytic_aa ? 1.0 : 0.0;
+
+    bool has_aa_constants = e.has<AntiAliased>();
+
     RenderPipelineDescriptor pipeline_desc;
 
-    pipeline_desc.vertex.bufferCount = 1;
-    pipeline_desc.vertex.buffers = &pipeline.vertex_layout;
+    bool has_vertices = pipeline.vertex_layout.attributeCount > 0;
+    pipeline_desc.vertex.bufferCount = has_vertices ? 1 : 0;
+    pipeline_desc.vertex.buffers = has_vertices ? &pipeline.vertex_layout : nullptr;
 
     pipeline_desc.vertex.module = shader_module;
     pipeline_desc.vertex.entryPoint = toWgpuStringView("vs_main");
-    pipeline_desc.vertex.constantCount = 0;
-    pipeline_desc.vertex.constants = nullptr;
+    pipeline_desc.vertex.constantCount = has_aa_constants ? 1 : 0;
+    pipeline_desc.vertex.constants = has_aa_constants ? &padding_constant : nullptr;
 
-    pipeline_desc.primitive.topology = PrimitiveTopology::TriangleList;
+    pipeline_desc.primitive.topology = pipeline.topology;
     pipeline_desc.primitive.stripIndexFormat = IndexFormat::Undefined;
     pipeline_desc.primitive.frontFace = FrontFace::CCW;
     pipeline_desc.primitive.cullMode = CullMode::None;
 
+    // Pipelines drawn in the main pass must match its attachments, when the entity id target is
+    // enabled shaders provide an fs_picking entry point that also outputs the id at location 1
+    bool post_process = e.has<PostProcess>();
+    bool picking = e.world().has<PickingTarget>() && !post_process;
+    bool writes_id = picking && !e.has<NotPickable>();
+
     FragmentState fragment_state;
     fragment_state.module = shader_module;
-    fragment_state.entryPoint = toWgpuStringView("fs_main");
-    fragment_state.constantCount = 0;
-    fragment_state.constants = nullptr;
+    fragment_state.entryPoint = toWgpuStringView(writes_id ? "fs_picking" : "fs_main");
+    if (post_process) {
+        fragment_state.entryPoint = toWgpuStringView(pipeline.fragment_entry_point);
+    }
+    fragment_state.constantCount = has_aa_constants ? 1 : 0;
+    fragment_state.constants = has_aa_constants ? &aa_constant : nullptr;
 
     BlendState blendState;
     // Usual alpha blending for the color:
@@ -49,19 +74,50 @@ void init_render_pipeline(WGPU &webgpu, flecs::entity e, RenderPipeline &pipelin
     blendState.alpha.dstFactor = BlendFactor::One;
     blendState.alpha.operation = BlendOperation::Add;
 
-    ColorTargetState colorTarget;
+    // Opaque pipelines write depth and replace the color, everything else only tests depth so
+    // blended shapes drawn afterwards are hidden behind opaque ones
+    bool depth = e.world().has<DepthTarget>() && !post_process;
+    bool depth_write = e.has<DepthWrite>();
+
+    ColorTargetState color_targets[2];
+    ColorTargetState &colorTarget = color_targets[0];
     colorTarget.format = format;
-    colorTarget.blend = &blendState;
+    colorTarget.blend = depth_write || post_process ? nullptr : &blendState;
     colorTarget.writeMask = ColorWriteMask::All;
 
-    fragment_state.targetCount = 1;
-    fragment_state.targets = &colorTarget;
+    // Integer targets can't be blended, the last shape drawn over a pixel owns it
+    ColorTargetState &id_target = color_targets[1];
+    id_target.format = TextureFormat::R32Uint;
+    id_target.blend = nullptr;
+    id_target.writeMask = writes_id ? ColorWriteMask::All : ColorWriteMask::None;
 
-    pipeline_desc.fragment = &fragment_state;
+    fragment_state.targetCount = picking ? 2 : 1;
+    fragment_state.targets = color_targets;
 
-    pipeline_desc.depthStencil = nullptr;
+    pipeline_desc.fragment = &fragment_state;
 
-    pipeline_desc.multisample.count = 1;
+    StencilFaceState stencil_face;
+    stencil_face.compare = CompareFunction::Always;
+    stencil_face.failOp = StencilOperation::Keep;
+    stencil_face.depthFailOp = StencilOperation::Keep;
+    stencil_face.passOp = StencilOperation::Keep;
+
+    DepthStencilState depth_stencil;
+    depth_stencil.format = TextureFormat::Depth24Plus;
+    depth_stencil.depthWriteEnabled = depth_write ? OptionalBool::True : OptionalBool::False;
+    // Equal depths pass so shapes on the same layer keep their draw order
+    depth_stencil.depthCompare = CompareFunction::LessEqual;
+    depth_stencil.stencilFront = stencil_face;
+    depth_stencil.stencilBack = stencil_face;
+    depth_stencil.stencilReadMask = 0;
+    depth_stencil.stencilWriteMask = 0;
+    depth_stencil.depthBias = 0;
+    depth_stencil.depthBiasSlopeScale = 0;
+    depth_stencil.depthBiasClamp = 0;
+
+    pipeline_desc.depthStencil = depth ? &depth_stencil : nullptr;
+
+    pipeline_desc.multisample.count = post_process ? 1 : settings.sample_count();
     pipeline_desc.multisample.mask = ~0u;
     pipeline_desc.multisample.alphaToCoverageEnabled = false;
 
@@ -82,7 +138,7 @@ void init_compute_pipeline(WGPU &webgpu, flecs::entity e, ComputePipeline &pipel
     ComputePipelineDescriptor pipeline_desc;
     pipeline_desc.compute.constantCount = 0;
     pipeline_desc.compute.constants = nullptr;
-    pipeline_desc.compute.entryPoint = toWgpuStringView("compute");
+    pipeline_desc.compute.entryPoint = toWgpuStringView(pipeline.entry_point);
     pipeline_desc.compute.module = shader_module;
 
     PipelineLayoutDescriptor pipeline_layout_desc;
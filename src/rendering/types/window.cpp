@@ -42,7 +42,7 @@ module::module(flecs::world &world) {
     auto window_e = world.entity<Window>();
     window_e.observe<Resize>([](flecs::entity e, Resize &resize) {
         flecs::world world{e.world()};
-        auto window = e.get_mut<Window>();
+        auto &window = e.get_mut<Window>();
         window.width = resize.width;
         window.height = resize.height;
 
@@ -50,22 +50,9 @@ module::module(flecs::world &world) {
 
         auto &webgpu = world.ensure<rendering::WGPU>();
 
-        using namespace wgpu;
-
         // if (resize.width > 0 && resize.height > 0) {
-        TextureFormat format = TextureFormat::BGRA8Unorm;
-        SurfaceConfiguration config;
-        config.nextInChain = nullptr;
-        config.width = resize.width;
-        config.height = resize.height;
-        config.format = format;
-        config.viewFormatCount = 0;
-        config.viewFormats = nullptr;
-        config.usage = TextureUsage::RenderAttachment;
-        config.device = webgpu.device;
-        config.presentMode = PresentMode::Fifo;
-        config.alphaMode = WGPUCompositeAlphaMode_Auto;
-        window.surface.configure(config);
+        rendering::configure_surface(webgpu, window, world.get<rendering::Settings>());
+        rendering::resize_targets(world, resize.width, resize.height);
         // } else {
         //     webgpu.swap_chain = nullptr;
         // }
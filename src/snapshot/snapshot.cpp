@@ -0,0 +1,379 @@
+#include "snapshot.hpp"
+#include "../include.hpp"
+#include "../spawn/spawn.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SNAPSHOT_MMAP
+#endif
+
+using namespace physics;
+
+namespace snapshot {
+
+// File layout:
+//   Header
+//   For every chunk: ChunkHeader, followed by one column per component in the chunk mask, in the
+//   order of the Column enum. Each chunk maps to a single flecs table, and every column is padded
+//   to 8 bytes so columns can be handed to ecs_bulk_init straight from the mapped file.
+constexpr uint32_t MAGIC = 0x534e5746; // "FWNS"
+constexpr uint32_t VERSION = 2;
+
+enum Column : uint32_t {
+    PositionColumn,
+    QuadColumn,
+    CircleColumn,
+    ColorColumn,
+    DynamicBodyColumn,
+    StaticBodyColumn,
+    BodyStateColumn,
+    LayerColumn,
+    LifetimeColumn,
+    ColumnCount
+};
+
+constexpr size_t column_sizes[ColumnCount] = {
+    sizeof(Position),    sizeof(Quad), sizeof(Circle),    sizeof(Color),
+    sizeof(DynamicBody), 0,            sizeof(BodyState), sizeof(Layer),
+    sizeof(lifetime::Lifetime),
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_count;
+    uint32_t reserved;
+};
+
+struct ChunkHeader {
+    uint32_t mask;
+    uint32_t count;
+};
+
+static bool has_column(uint32_t mask, uint32_t column) { return (mask & (1u << column)) != 0; }
+
+static size_t column_stride(uint32_t column, uint32_t count) {
+    return (column_sizes[column] * count + 7) & ~size_t(7);
+}
+
+// Read-only view of a snapshot file, memory mapped where the platform allows it
+struct MappedFile {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+#ifdef SNAPSHOT_MMAP
+    void *mapping = MAP_FAILED;
+#else
+    std::vector<uint8_t> storage;
+#endif
+
+    bool open(const std::filesystem::path &path) {
+#ifdef SNAPSHOT_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size = (size_t)info.st_size;
+        // Private mapping so flecs may treat the columns as movable sources
+        mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        data = (const uint8_t *)mapping;
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.seekg(0, std::ios::end);
+        size = file.tellg();
+        file.seekg(0);
+        storage.resize(size);
+        file.read((char *)storage.data(), size);
+        data = storage.data();
+#endif
+        return true;
+    }
+
+    ~MappedFile() {
+#ifdef SNAPSHOT_MMAP
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, size);
+        }
+#endif
+    }
+};
+
+// Opened and validated file, the chunk columns point into the mapping
+struct Snapshot {
+    struct Chunk {
+        ChunkHeader header;
+        const uint8_t *columns[ColumnCount];
+    };
+
+    MappedFile file;
+    std::vector<Chunk> chunks;
+};
+
+static void write_column(std::ofstream &file, uint32_t column, const void *data, uint32_t count) {
+    static const char padding[8] = {};
+    size_t size = column_sizes[column] * count;
+    file.write((const char *)data, size);
+    file.write(padding, column_stride(column, count) - size);
+}
+
+bool save(flecs::world &world, const std::filesystem::path &path, flecs::id_t with) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not open snapshot for writing: " << path << std::endl;
+        return false;
+    }
+
+    Header header{MAGIC, VERSION, 0, 0};
+    file.write((const char *)&header, sizeof(header));
+
+    auto builder =
+        world.query_builder<const Position, const Quad *, const Circle *, const Color *,
+                            const DynamicBody *, const BodyPtr *, const Layer *,
+                            const lifetime::Lifetime *>();
+    builder.with<StaticBody>().optional().without<Exclude>();
+    if (with != 0) {
+        builder.with(with);
+    }
+    auto query = builder.build();
+
+    std::vector<BodyState> states;
+    query.run([&](flecs::iter &it) {
+        while (it.next()) {
+            if (!it.is_set(1) && !it.is_set(2)) {
+                continue;
+            }
+
+            uint32_t count = (uint32_t)it.count();
+            const void *columns[ColumnCount] = {};
+            columns[PositionColumn] = &it.field<const Position>(0)[0];
+            if (it.is_set(1)) {
+                columns[QuadColumn] = &it.field<const Quad>(1)[0];
+            }
+            if (it.is_set(2)) {
+                columns[CircleColumn] = &it.field<const Circle>(2)[0];
+            }
+            if (it.is_set(3)) {
+                columns[ColorColumn] = &it.field<const Color>(3)[0];
+            }
+            if (it.is_set(4)) {
+                columns[DynamicBodyColumn] = &it.field<const DynamicBody>(4)[0];
+            }
+            if (it.is_set(5)) {
+                auto bodies = it.field<const BodyPtr>(5);
+                states.resize(count);
+                for (uint32_t i = 0; i < count; i++) {
+                    b2Body *body = bodies[i].ptr;
+                    states[i] = {body->GetLinearVelocity(), body->GetAngularVelocity(),
+                                 body->IsAwake()};
+                }
+                columns[BodyStateColumn] = states.data();
+            }
+            if (it.is_set(6)) {
+                columns[LayerColumn] = &it.field<const Layer>(6)[0];
+            }
+            if (it.is_set(7)) {
+                columns[LifetimeColumn] = &it.field<const lifetime::Lifetime>(7)[0];
+            }
+
+            ChunkHeader chunk{0, count};
+            for (uint32_t c = 0; c < ColumnCount; c++) {
+                if (columns[c] != nullptr) {
+                    chunk.mask |= 1u << c;
+                }
+            }
+            if (it.is_set(8)) {
+                chunk.mask |= 1u << StaticBodyColumn;
+            }
+
+            file.write((const char *)&chunk, sizeof(chunk));
+            for (uint32_t c = 0; c < ColumnCount; c++) {
+                if (columns[c] != nullptr) {
+                    write_column(file, c, columns[c], count);
+                }
+            }
+            header.chunk_count++;
+        }
+    });
+
+    // Offloaded shapes are copied chunk by chunk, their columns are already padded
+    const Offloaded *offloaded = world.try_get<Offloaded>();
+    if (with == 0 && offloaded != nullptr && offloaded->files != nullptr) {
+        for (const auto &offloaded_path : offloaded->files(world)) {
+            auto contents = read(offloaded_path);
+            if (contents == nullptr) {
+                continue;
+            }
+            for (auto &chunk : contents->chunks) {
+                file.write((const char *)&chunk.header, sizeof(chunk.header));
+                for (uint32_t c = 0; c < ColumnCount; c++) {
+                    if (chunk.columns[c] != nullptr) {
+                        file.write((const char *)chunk.columns[c],
+                                   column_stride(c, chunk.header.count));
+                    }
+                }
+                header.chunk_count++;
+            }
+        }
+    }
+
+    file.seekp(0);
+    file.write((const char *)&header, sizeof(header));
+    return file.good();
+}
+
+// Delete the entities save() writes: a Position and a Quad or Circle, not excluded. Bodies are
+// returned to the pool by the BodyPtr remove hook and picked up again by the load.
+static void clear_shapes(flecs::world &world) {
+    auto query = world.query_builder<const Position>()
+                     .with<Quad>()
+                     .or_()
+                     .with<Circle>()
+                     .without<Exclude>()
+                     .build();
+    world.defer([&] { query.each([](flecs::entity e, const Position &) { e.destruct(); }); });
+}
+
+static void load_chunk(flecs::world &world, const ChunkHeader &chunk,
+                       const uint8_t *const columns[ColumnCount]) {
+    spawn::ShapeDesc desc;
+    desc.count = (int32_t)chunk.count;
+    desc.positions = (const Position *)columns[PositionColumn];
+    desc.quads = (const Quad *)columns[QuadColumn];
+    desc.circles = (const Circle *)columns[CircleColumn];
+    desc.colors = (const Color *)columns[ColorColumn];
+    desc.dynamic_bodies = (const DynamicBody *)columns[DynamicBodyColumn];
+    desc.body_states = (const BodyState *)columns[BodyStateColumn];
+    desc.layers = (const Layer *)columns[LayerColumn];
+    desc.lifetimes = (const lifetime::Lifetime *)columns[LifetimeColumn];
+    desc.is_static = has_column(chunk.mask, StaticBodyColumn);
+    spawn::shapes(world, desc);
+}
+
+std::shared_ptr<const Snapshot> read(const std::filesystem::path &path) {
+    auto snapshot = std::make_shared<Snapshot>();
+    MappedFile &file = snapshot->file;
+    if (!file.open(path)) {
+        std::cerr << "Could not open snapshot: " << path << std::endl;
+        return nullptr;
+    }
+
+    if (file.size < sizeof(Header)) {
+        std::cerr << "Invalid snapshot: " << path << std::endl;
+        return nullptr;
+    }
+    Header header;
+    std::memcpy(&header, file.data, sizeof(Header));
+    if (header.magic != MAGIC || header.version != VERSION) {
+        std::cerr << "Invalid snapshot version: " << path << std::endl;
+        return nullptr;
+    }
+
+    // Validate the whole file before touching the world
+    auto &chunks = snapshot->chunks;
+    chunks.resize(header.chunk_count);
+    size_t offset = sizeof(Header);
+    for (auto &chunk : chunks) {
+        if (offset + sizeof(ChunkHeader) > file.size) {
+            std::cerr << "Truncated snapshot: " << path << std::endl;
+            return nullptr;
+        }
+        std::memcpy(&chunk.header, file.data + offset, sizeof(ChunkHeader));
+        offset += sizeof(ChunkHeader);
+
+        uint32_t mask = chunk.header.mask;
+        bool has_shape = has_column(mask, QuadColumn) != has_column(mask, CircleColumn);
+        bool has_body = has_column(mask, DynamicBodyColumn) || has_column(mask, StaticBodyColumn);
+        if (!has_column(mask, PositionColumn) || !has_shape ||
+            (has_body && !has_column(mask, BodyStateColumn))) {
+            std::cerr << "Invalid snapshot chunk: " << path << std::endl;
+            return nullptr;
+        }
+
+        for (uint32_t c = 0; c < ColumnCount; c++) {
+            chunk.columns[c] = nullptr;
+            if (has_column(mask, c) && column_sizes[c] > 0) {
+                size_t stride = column_stride(c, chunk.header.count);
+                if (offset + stride > file.size) {
+                    std::cerr << "Truncated snapshot: " << path << std::endl;
+                    return nullptr;
+                }
+                chunk.columns[c] = file.data + offset;
+                offset += stride;
+            }
+        }
+    }
+
+    return snapshot;
+}
+
+void insert(flecs::world &world, const Snapshot &snapshot) {
+    for (auto &chunk : snapshot.chunks) {
+        if (chunk.header.count > 0) {
+            load_chunk(world, chunk.header, chunk.columns);
+        }
+    }
+}
+
+bool load(flecs::world &world, const std::filesystem::path &path) {
+    auto snapshot = read(path);
+    if (snapshot == nullptr) {
+        return false;
+    }
+    const Offloaded *offloaded = world.try_get<Offloaded>();
+    if (offloaded != nullptr && offloaded->discard != nullptr) {
+        offloaded->discard(world);
+    }
+    clear_shapes(world);
+    insert(world, *snapshot);
+    return true;
+}
+
+module::module(flecs::world &world) {
+    world.component<Exclude>();
+    world.component<Offloaded>();
+    world.component<Save>();
+    world.component<Load>();
+
+    world.system("snapshot::Process")
+        .kind(flecs::OnLoad)
+        .immediate()
+        .run([](flecs::iter &it) {
+            flecs::world world = it.world();
+
+            if (const Save *request = world.try_get<Save>()) {
+                auto path = request->path;
+                world.remove<Save>();
+                if (save(world, path)) {
+                    std::cout << "Saved snapshot: " << path << std::endl;
+                }
+            }
+
+            if (const Load *request = world.try_get<Load>()) {
+                auto path = request->path;
+                world.remove<Load>();
+                if (load(world, path)) {
+                    std::cout << "Loaded snapshot: " << path << std::endl;
+                }
+            }
+        });
+}
+
+} // namespace snapshot
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "flecs.h"
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace snapshot {
+
+// Singleton requests, processed at the start of the next frame outside of deferred mode
+struct Save {
+    std::filesystem::path path;
+};
+
+struct Load {
+    std::filesystem::path path;
+};
+
+// Entities rebuilt from other data, such as terrain, are neither saved nor cleared by snapshots
+struct Exclude {};
+
+// Singleton set by a module that moves shapes out of the world into snapshot files of its own,
+// like streaming does with cells out of range. Full saves copy the shapes of every file listed by
+// files, loads call discard first so those files can't bring old shapes back on top.
+struct Offloaded {
+    std::vector<std::filesystem::path> (*files)(flecs::world &world) = nullptr;
+    void (*discard)(flecs::world &world) = nullptr;
+};
+
+// Write every shape entity with its body state, Layer and Lifetime to a columnar snapshot file.
+// When with is set only entities that have it are written, otherwise offloaded shapes are
+// written as well.
+bool save(flecs::world &world, const std::filesystem::path &path, flecs::id_t with = 0);
+
+// Replace every shape entity, offloaded ones included, with the contents of a snapshot file.
+// Entities are created directly in their final table, so this must not be called while the world
+// is deferred.
+bool load(flecs::world &world, const std::filesystem::path &path);
+
+// Snapshot file validated by read, kept mapped until it is released
+struct Snapshot;
+
+// Open and validate a snapshot without touching the world, safe to call from any thread
+std::shared_ptr<const Snapshot> read(const std::filesystem::path &path);
+
+// Spawn the contents of a snapshot next to the existing entities, must not be called while the
+// world is deferred
+void insert(flecs::world &world, const Snapshot &snapshot);
+
+struct module {
+    module(flecs::world &world);
+};
+
+} // namespace snapshot
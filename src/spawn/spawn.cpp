@@ -0,0 +1,67 @@
+#include "spawn.hpp"
+#include <vector>
+
+using namespace physics;
+
+namespace spawn {
+
+const flecs::entity_t *shapes(flecs::world &world, const ShapeDesc &desc) {
+    ecs_assert(desc.positions != nullptr, ECS_INVALID_PARAMETER, "shapes need positions");
+    ecs_assert((desc.quads != nullptr) != (desc.circles != nullptr), ECS_INVALID_PARAMETER,
+               "exactly one of quads or circles must be set");
+
+    ecs_bulk_desc_t bulk = {};
+    void *data[FLECS_ID_DESC_MAX];
+    int32_t id_count = 0;
+
+    auto add = [&](ecs_id_t id, const void *ptr) {
+        bulk.ids[id_count] = id;
+        data[id_count] = const_cast<void *>(ptr);
+        id_count++;
+    };
+
+    add(world.id<Position>(), desc.positions);
+    if (desc.quads != nullptr) {
+        add(world.id<Quad>(), desc.quads);
+    }
+    if (desc.circles != nullptr) {
+        add(world.id<Circle>(), desc.circles);
+    }
+    if (desc.colors != nullptr) {
+        add(world.id<Color>(), desc.colors);
+    }
+    if (desc.dynamic_bodies != nullptr) {
+        add(world.id<DynamicBody>(), desc.dynamic_bodies);
+    }
+    if (desc.layers != nullptr) {
+        add(world.id<Layer>(), desc.layers);
+    }
+    if (desc.lifetimes != nullptr) {
+        add(world.id<lifetime::Lifetime>(), desc.lifetimes);
+    }
+    if (desc.is_static) {
+        add(world.id<StaticBody>(), nullptr);
+    }
+
+    // Entities are inserted with their BodyPtr, so the single-entity body observers never match
+    std::vector<BodyPtr> bodies;
+    if (desc.dynamic_bodies != nullptr || desc.is_static) {
+        PhysicsWorld &p_world = world.ensure<PhysicsWorld>();
+        bodies.resize(desc.count);
+        create_bodies(p_world, desc.count, desc.positions, desc.quads, desc.circles,
+                      desc.dynamic_bodies, desc.body_states, bodies.data());
+        add(world.id<BodyPtr>(), bodies.data());
+    }
+
+    bulk.count = desc.count;
+    bulk.data = data;
+    const ecs_entity_t *entities = ecs_bulk_init(world, &bulk);
+
+    for (size_t i = 0; i < bodies.size(); i++) {
+        bodies[i].ptr->GetUserData().pointer = (uintptr_t)entities[i];
+    }
+
+    return entities;
+}
+
+} // namespace spawn
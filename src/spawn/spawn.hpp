@@ -0,0 +1,30 @@
+#pragma once
+
+#include "flecs.h"
+#include "../common.hpp"
+#include "../lifetime/lifetime.hpp"
+#include "../physics/physics.hpp"
+
+namespace spawn {
+
+// Structure of arrays describing `count` shapes. Exactly one of quads or circles must be set,
+// every other array is optional. Shapes get a body when dynamic_bodies is set or is_static is true.
+struct ShapeDesc {
+    int32_t count = 0;
+    const Position *positions = nullptr;
+    const Quad *quads = nullptr;
+    const Circle *circles = nullptr;
+    const Color *colors = nullptr;
+    const DynamicBody *dynamic_bodies = nullptr;
+    const physics::BodyState *body_states = nullptr;
+    const Layer *layers = nullptr;
+    const lifetime::Lifetime *lifetimes = nullptr;
+    bool is_static = false;
+};
+
+// Create shapes directly in their final table with ecs_bulk_init, creating their bodies in one
+// batched pass beforehand so no per-entity observers run. Must not be called while the world is
+// deferred. The returned ids are owned by flecs and valid until the next bulk operation.
+const flecs::entity_t *shapes(flecs::world &world, const ShapeDesc &desc);
+
+} // namespace spawn
@@ -0,0 +1,256 @@
+#include "streaming.hpp"
+#include "../include.hpp"
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+namespace streaming {
+
+enum class CellState : uint8_t { Unloaded, Loading, Loaded };
+
+struct CellEntry {
+    flecs::entity_t entity = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    CellState state = CellState::Unloaded;
+    std::future<std::shared_ptr<const snapshot::Snapshot>> pending;
+};
+
+// Cells around the camera and cells still being read. Unloaded cells are dropped together with
+// their entity, the file on disk is all that's needed to load them again.
+struct CellIndex {
+    std::unordered_map<uint64_t, CellEntry> cells;
+
+    // Pending reads can't be copied, spelled out so flecs doesn't register a copy hook
+    CellIndex() = default;
+    CellIndex(const CellIndex &) = delete;
+    CellIndex &operator=(const CellIndex &) = delete;
+    CellIndex(CellIndex &&) = default;
+    CellIndex &operator=(CellIndex &&) = default;
+};
+
+static uint64_t cell_key(int32_t x, int32_t y) {
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+static int32_t cell_coord(float value, float cell_size) {
+    return (int32_t)std::floor(value / cell_size);
+}
+
+static std::filesystem::path cell_path(const StreamSettings &settings, int32_t x, int32_t y) {
+    return settings.directory /
+           ("cell_" + std::to_string(x) + "_" + std::to_string(y) + ".snapshot");
+}
+
+// Files of cells written out by this session, every other shape is in the world
+static std::vector<std::filesystem::path> cell_files(const StreamSettings &settings) {
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (auto &entry : std::filesystem::directory_iterator(settings.directory, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("cell_", 0) == 0 && entry.path().extension() == ".snapshot") {
+            files.push_back(entry.path());
+        }
+    }
+    return files;
+}
+
+static void remove_cell_files(const StreamSettings &settings) {
+    for (auto &path : cell_files(settings)) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+}
+
+static CellEntry &find_cell(flecs::world &world, CellIndex &index, int32_t x, int32_t y) {
+    auto [it, inserted] = index.cells.try_emplace(cell_key(x, y));
+    CellEntry &cell = it->second;
+    if (inserted) {
+        cell.entity = world.entity().set<Cell>({x, y});
+        cell.x = x;
+        cell.y = y;
+    }
+    return cell;
+}
+
+// Start reading the file of an unloaded cell, cells without a file are loaded right away
+static void request_load(const StreamSettings &settings, CellEntry &cell) {
+    if (cell.state != CellState::Unloaded) {
+        return;
+    }
+    auto path = cell_path(settings, cell.x, cell.y);
+    std::error_code error;
+    if (!std::filesystem::exists(path, error)) {
+        cell.state = CellState::Loaded;
+        return;
+    }
+
+#ifdef __EMSCRIPTEN__
+    // No worker threads, the file is read when the result is polled
+    auto policy = std::launch::deferred;
+#else
+    auto policy = std::launch::async;
+#endif
+    cell.pending = std::async(policy, [path] { return snapshot::read(path); });
+    cell.state = CellState::Loading;
+}
+
+static bool is_ready(const CellEntry &cell) {
+    return cell.pending.wait_for(std::chrono::seconds(0)) != std::future_status::timeout;
+}
+
+static std::vector<std::filesystem::path> offloaded_files(flecs::world &world) {
+    return cell_files(world.get<StreamSettings>());
+}
+
+// A snapshot replaces every shape, cells on disk or still being read would add theirs on top. The
+// cells stay in the index as loaded and empty, shapes of the snapshot are assigned to them again.
+static void discard_cells(flecs::world &world) {
+    for (auto &[key, cell] : world.get_mut<CellIndex>().cells) {
+        if (cell.state == CellState::Loading) {
+            cell.pending.wait();
+            cell.pending = {};
+            cell.state = CellState::Loaded;
+        }
+    }
+    remove_cell_files(world.get<StreamSettings>());
+}
+
+static void assign_cell(flecs::entity e, const Position &pos) {
+    flecs::world world = e.world();
+    const StreamSettings &settings = world.get<StreamSettings>();
+    CellEntry &cell = find_cell(world, world.get_mut<CellIndex>(),
+                                cell_coord(pos.x, settings.cell_size),
+                                cell_coord(pos.y, settings.cell_size));
+    if (e.target<InCell>().id() != cell.entity) {
+        e.add<InCell>(cell.entity);
+    }
+    // Shapes moving into a cell that was written out pull the rest of it back in
+    request_load(settings, cell);
+}
+
+module::module(flecs::world &world) {
+    world.component<InCell>().add(flecs::Exclusive);
+    world.component<Cell>().member<int32_t>("x").member<int32_t>("y");
+    world.component<StreamStats>()
+        .member<uint32_t>("loaded_cells")
+        .member<uint32_t>("pending_loads")
+        .member<uint32_t>("loads")
+        .member<uint32_t>("unloads");
+    world.set<StreamStats>({});
+    world.add<CellIndex>();
+
+    // Cells are written to the directory of settings set before import, or the default one.
+    // Cells left by an earlier run belong to a world that no longer exists.
+    const StreamSettings &settings = world.ensure<StreamSettings>();
+    std::error_code error;
+    std::filesystem::create_directories(settings.directory, error);
+    if (error) {
+        std::cerr << "Could not create stream directory: " << settings.directory << std::endl;
+    }
+    remove_cell_files(settings);
+    world.set<snapshot::Offloaded>({offloaded_files, discard_cells});
+
+    world.system<const Position>()
+        .with<Quad>()
+        .or_()
+        .with<Circle>()
+        .without<snapshot::Exclude>()
+        .without<Sleeping>()
+        .kind(flecs::PostUpdate)
+        .each(assign_cell);
+
+    // Sleeping shapes don't move, but shapes created asleep still need a cell
+    world.system<const Position>()
+        .with<Quad>()
+        .or_()
+        .with<Circle>()
+        .without<snapshot::Exclude>()
+        .with<Sleeping>()
+        .without<InCell>(flecs::Wildcard)
+        .kind(flecs::PostUpdate)
+        .each(assign_cell);
+
+    // Runs outside of deferred mode, inserting snapshots creates entities directly in their tables
+    world.system("streaming::Stream")
+        .kind(flecs::OnLoad)
+        .immediate()
+        .run([](flecs::iter &it) {
+            flecs::world world = it.world();
+            const StreamSettings &settings = world.get<StreamSettings>();
+            auto &index = world.get_mut<CellIndex>();
+            auto &stats = world.get_mut<StreamStats>();
+            Camera camera = world.has<Camera>() ? world.get<Camera>() : Camera{};
+
+            // Insert cells whose file finished reading, the shapes are only in the world afterwards
+            for (auto &[key, cell] : index.cells) {
+                if (cell.state != CellState::Loading || !is_ready(cell)) {
+                    continue;
+                }
+                auto contents = cell.pending.get();
+                if (contents != nullptr) {
+                    snapshot::insert(world, *contents);
+                    std::error_code error;
+                    std::filesystem::remove(cell_path(settings, cell.x, cell.y), error);
+                }
+                cell.state = CellState::Loaded;
+                stats.loads++;
+            }
+
+            // Start reading cells within range of the camera
+            float size = settings.cell_size;
+            int32_t min_x = cell_coord(camera.x - settings.load_radius, size);
+            int32_t max_x = cell_coord(camera.x + settings.load_radius, size);
+            int32_t min_y = cell_coord(camera.y - settings.load_radius, size);
+            int32_t max_y = cell_coord(camera.y + settings.load_radius, size);
+            for (int32_t y = min_y; y <= max_y; y++) {
+                for (int32_t x = min_x; x <= max_x; x++) {
+                    request_load(settings, find_cell(world, index, x, y));
+                }
+            }
+
+            // Write out and delete cells that are out of range, empty cells only drop their file
+            stats.loaded_cells = 0;
+            stats.pending_loads = 0;
+            for (auto it = index.cells.begin(); it != index.cells.end();) {
+                CellEntry &cell = it->second;
+                if (cell.state == CellState::Loading) {
+                    stats.pending_loads++;
+                }
+                if (cell.state != CellState::Loaded) {
+                    it++;
+                    continue;
+                }
+                float distance_x = std::abs((cell.x + 0.5f) * size - camera.x) - size / 2.0f;
+                float distance_y = std::abs((cell.y + 0.5f) * size - camera.y) - size / 2.0f;
+                if (distance_x <= settings.unload_radius && distance_y <= settings.unload_radius) {
+                    stats.loaded_cells++;
+                    it++;
+                    continue;
+                }
+
+                flecs::id_t in_cell = world.pair<InCell>(cell.entity);
+                auto path = cell_path(settings, cell.x, cell.y);
+                if (world.count(in_cell) > 0) {
+                    if (!snapshot::save(world, path, in_cell)) {
+                        stats.loaded_cells++;
+                        it++;
+                        continue;
+                    }
+                    world.delete_with(in_cell);
+                } else {
+                    std::error_code error;
+                    std::filesystem::remove(path, error);
+                }
+                // Nothing is in the cell anymore, so deleting it leaves no pair behind
+                world.entity(cell.entity).destruct();
+                it = index.cells.erase(it);
+                stats.unloads++;
+            }
+        });
+}
+
+} // namespace streaming
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "flecs.h"
+#include <cstdint>
+#include <filesystem>
+
+namespace streaming {
+
+// Relationship from a shape entity to the cell its position is in, exclusive
+struct InCell {};
+
+// Square of the world grid. Shapes in cells further from the camera than the unload radius are
+// written to a file in the stream directory and deleted, and are read back on a worker thread
+// once the camera comes within the load radius again.
+struct Cell {
+    int32_t x;
+    int32_t y;
+};
+
+struct StreamSettings {
+    float cell_size = 512.0f;
+    float load_radius = 1024.0f;
+    float unload_radius = 1536.0f;
+    std::filesystem::path directory = "world";
+};
+
+// Counters for the inspector
+struct StreamStats {
+    uint32_t loaded_cells;
+    uint32_t pending_loads;
+    uint32_t loads;
+    uint32_t unloads;
+};
+
+// Entities with a Position and a Quad or Circle are streamed, with their Color, body, Layer and
+// Lifetime. Lifetimes don't run down while a cell is on disk. Everything else, like compound
+// Shapes, emitters and entities tagged with snapshot::Exclude, stays resident.
+//
+// Cell files only live as long as the session: importing the module deletes the ones left in the
+// directory, and a cell's file is deleted once its shapes are back in the world. Snapshot saves
+// include the cells on disk and snapshot loads discard them, see snapshot::Offloaded.
+struct module {
+    module(flecs::world &world);
+};
+
+} // namespace streaming
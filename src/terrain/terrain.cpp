@@ -0,0 +1,415 @@
+#include "terrain.hpp"
+#include "../include.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace terrain {
+
+using Point = std::array<int32_t, 2>;
+
+// Tile range of a chunk, max exclusive
+struct TileRange {
+    int32_t min_x;
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+
+    int32_t width() const { return max_x - min_x; }
+    int32_t height() const { return max_y - min_y; }
+};
+
+struct TileRect {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+static uint64_t chunk_key(int32_t x, int32_t y) {
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+static TileRange chunk_range(const TileMap &map, int32_t x, int32_t y) {
+    return {x * map.chunk_size, y * map.chunk_size,
+            std::min((x + 1) * map.chunk_size, map.width),
+            std::min((y + 1) * map.chunk_size, map.height)};
+}
+
+// Greedy rectangles covering the solid tiles: the longest run along a row, grown upwards while
+// the rows above have the same run. Coordinates are relative to the chunk.
+static void merge_rects(const TileMap &map, const TileRange &range, std::vector<TileRect> &out) {
+    std::vector<uint8_t> used((size_t)(range.width() * range.height()));
+    auto free_solid = [&](int32_t x, int32_t y) {
+        return map.solid(range.min_x + x, range.min_y + y) && !used[y * range.width() + x];
+    };
+
+    for (int32_t y = 0; y < range.height(); y++) {
+        for (int32_t x = 0; x < range.width(); x++) {
+            if (!free_solid(x, y)) {
+                continue;
+            }
+            int32_t width = 1;
+            while (x + width < range.width() && free_solid(x + width, y)) {
+                width++;
+            }
+            int32_t height = 1;
+            for (; y + height < range.height(); height++) {
+                bool full = true;
+                for (int32_t i = x; i < x + width && full; i++) {
+                    full = free_solid(i, y + height);
+                }
+                if (!full) {
+                    break;
+                }
+            }
+            for (int32_t j = y; j < y + height; j++) {
+                std::fill_n(used.begin() + j * range.width() + x, width, 1);
+            }
+            out.push_back({x, y, width, height});
+        }
+    }
+}
+
+// Outline of solid tiles in tile corners relative to the chunk, with the solid side on the left.
+// Outlines that cross into a neighbouring chunk are open, the ghost corners continue them there.
+struct Outline {
+    std::vector<Point> points;
+    bool loop = true;
+    Point ghost_start = {};
+    Point ghost_end = {};
+};
+
+// Direction the outline of the whole map leaves a corner in, after arriving in direction `in`.
+// Where solid tiles touch diagonally the outline turns left, into the solid side, so every tile
+// is closed off on its own instead of the outline touching itself at the corner.
+static Point next_direction(const TileMap &map, Point corner, Point in) {
+    int32_t x = corner[0], y = corner[1];
+    bool bottom_left = map.solid(x - 1, y - 1), bottom_right = map.solid(x, y - 1);
+    bool top_left = map.solid(x - 1, y), top_right = map.solid(x, y);
+    Point out[2];
+    int32_t count = 0;
+    if (top_right && !bottom_right) {
+        out[count++] = {1, 0};
+    }
+    if (top_left && !top_right) {
+        out[count++] = {0, 1};
+    }
+    if (bottom_left && !top_left) {
+        out[count++] = {-1, 0};
+    }
+    if (bottom_right && !bottom_left) {
+        out[count++] = {0, -1};
+    }
+    Point left = {-in[1], in[0]};
+    return count == 2 && out[1] == left ? out[1] : out[0];
+}
+
+// Direction the outline of the whole map arrives at a corner in, before leaving in direction `out`
+static Point previous_direction(const TileMap &map, Point corner, Point out) {
+    int32_t x = corner[0], y = corner[1];
+    bool bottom_left = map.solid(x - 1, y - 1), bottom_right = map.solid(x, y - 1);
+    bool top_left = map.solid(x - 1, y), top_right = map.solid(x, y);
+    Point in[2];
+    int32_t count = 0;
+    if (top_left && !bottom_left) {
+        in[count++] = {1, 0};
+    }
+    if (bottom_left && !bottom_right) {
+        in[count++] = {0, 1};
+    }
+    if (bottom_right && !top_right) {
+        in[count++] = {-1, 0};
+    }
+    if (top_right && !top_left) {
+        in[count++] = {0, -1};
+    }
+    // Turning left from it leads to `out`
+    Point right = {out[1], -out[0]};
+    return count == 2 && in[1] == right ? in[1] : in[0];
+}
+
+// Outlines of the solid tiles of a chunk. Tiles of the neighbouring chunks count, so no edges run
+// along the seams and the outline of continuous ground is split into open chains at the seams
+// instead of every chunk closing on itself. Points on straight runs are dropped.
+static void trace_outlines(const TileMap &map, const TileRange &range,
+                           std::vector<Outline> &outlines) {
+    int32_t stride = range.width() + 1;
+    auto index = [&](Point p) { return p[1] * stride + p[0]; };
+    auto corner = [&](int32_t i) { return Point{i % stride, i / stride}; };
+    auto solid = [&](int32_t x, int32_t y) { return map.solid(range.min_x + x, range.min_y + y); };
+
+    // Every corner has at most two outgoing edges, where solid tiles touch diagonally. Only the
+    // edges of tiles in the chunk are added, so outlines leaving the chunk end at a corner
+    // without outgoing edges and start at one without incoming edges.
+    std::vector<std::array<int32_t, 2>> outgoing((size_t)(stride * (range.height() + 1)),
+                                                 {-1, -1});
+    std::vector<uint8_t> incoming(outgoing.size());
+    size_t edge_count = 0;
+    auto add_edge = [&](Point from, Point to) {
+        auto &edges = outgoing[index(from)];
+        edges[edges[0] < 0 ? 0 : 1] = index(to);
+        incoming[index(to)]++;
+        edge_count++;
+    };
+
+    for (int32_t y = 0; y < range.height(); y++) {
+        for (int32_t x = 0; x < range.width(); x++) {
+            if (!solid(x, y)) {
+                continue;
+            }
+            if (!solid(x, y - 1)) {
+                add_edge({x, y}, {x + 1, y});
+            }
+            if (!solid(x + 1, y)) {
+                add_edge({x + 1, y}, {x + 1, y + 1});
+            }
+            if (!solid(x, y + 1)) {
+                add_edge({x + 1, y + 1}, {x, y + 1});
+            }
+            if (!solid(x - 1, y)) {
+                add_edge({x, y + 1}, {x, y});
+            }
+        }
+    }
+
+    // Same turn as next_direction, limited to the edges that are left
+    auto pick = [&](int32_t from, int32_t current) {
+        auto &edges = outgoing[current];
+        if (edges[0] < 0 || edges[1] < 0) {
+            return edges[0] >= 0 ? 0 : 1;
+        }
+        int32_t dx = current % stride - from % stride;
+        int32_t dy = current / stride - from / stride;
+        int32_t left = current + dx * stride - dy;
+        return edges[1] == left ? 1 : 0;
+    };
+    auto global = [&](Point p) { return Point{range.min_x + p[0], range.min_y + p[1]}; };
+
+    // In and out degrees match at every corner inside a loop, so its walk returns to where it
+    // started. A loop only ends once it would leave the start through the first edge again, a
+    // start on a diagonal corner is passed through first. Open outlines end where the edges do.
+    std::vector<Point> walk;
+    auto trace = [&](int32_t start, bool loop) {
+        walk.clear();
+        walk.push_back(corner(start));
+        int32_t first = outgoing[start][0] >= 0 ? 0 : 1;
+        int32_t from = start;
+        int32_t current = outgoing[start][first];
+        if (!loop) {
+            outgoing[start][first] = -1;
+            edge_count--;
+        }
+        while (true) {
+            bool open_end = outgoing[current][0] < 0 && outgoing[current][1] < 0;
+            int32_t slot = open_end ? -1 : pick(from, current);
+            if (loop && current == start && slot == first) {
+                break;
+            }
+            walk.push_back(corner(current));
+            if (open_end) {
+                break;
+            }
+            int32_t next = outgoing[current][slot];
+            outgoing[current][slot] = -1;
+            edge_count--;
+            from = current;
+            current = next;
+        }
+
+        Outline outline;
+        outline.loop = loop;
+        size_t n = walk.size();
+        if (loop) {
+            outgoing[start][first] = -1;
+            edge_count--;
+        } else {
+            Point start_point = walk[0], end_point = walk[n - 1];
+            Point out = {walk[1][0] - start_point[0], walk[1][1] - start_point[1]};
+            Point in = {end_point[0] - walk[n - 2][0], end_point[1] - walk[n - 2][1]};
+            Point before = previous_direction(map, global(start_point), out);
+            Point after = next_direction(map, global(end_point), in);
+            outline.ghost_start = {start_point[0] - before[0], start_point[1] - before[1]};
+            outline.ghost_end = {end_point[0] + after[0], end_point[1] + after[1]};
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            bool end = !loop && (i == 0 || i == n - 1);
+            const Point &prev = walk[(i + n - 1) % n];
+            const Point &point = walk[i];
+            const Point &next = walk[(i + 1) % n];
+            bool straight = (prev[0] == point[0] && point[0] == next[0]) ||
+                            (prev[1] == point[1] && point[1] == next[1]);
+            if (end || !straight) {
+                outline.points.push_back(point);
+            }
+        }
+        outlines.push_back(std::move(outline));
+    };
+
+    for (int32_t start = 0; start < (int32_t)outgoing.size() && edge_count > 0; start++) {
+        if (incoming[start] == 0 && outgoing[start][0] >= 0) {
+            trace(start, false);
+        }
+    }
+    for (int32_t start = 0; start < (int32_t)outgoing.size() && edge_count > 0; start++) {
+        while (outgoing[start][0] >= 0 || outgoing[start][1] >= 0) {
+            trace(start, true);
+        }
+    }
+}
+
+static flecs::entity build_chunk(flecs::entity map_entity, const TileMap &map, int32_t x,
+                                 int32_t y) {
+    flecs::world world = map_entity.world();
+    TileRange range = chunk_range(map, x, y);
+    float origin_x = map.origin_x + range.min_x * map.tile_size;
+    float origin_y = map.origin_y + range.min_y * map.tile_size;
+
+    auto chunk = world.entity()
+                     .child_of(map_entity)
+                     .add<snapshot::Exclude>()
+                     .add<lifetime::Persistent>()
+                     .set<TileChunk>({x, y})
+                     .set<Position>({origin_x, origin_y, 0.0f});
+
+    std::vector<Outline> outlines;
+    trace_outlines(map, range, outlines);
+    if (!outlines.empty()) {
+        auto to_local = [&](Point p) {
+            return std::array<float, 2>{p[0] * map.tile_size, p[1] * map.tile_size};
+        };
+        Shapes shapes;
+        for (const Outline &outline : outlines) {
+            ShapePart part;
+            part.kind = ShapePart::Kind::Chain;
+            part.loop = outline.loop;
+            part.material.density = 0.0f;
+            for (const Point &p : outline.points) {
+                part.points.push_back(to_local(p));
+            }
+            if (!outline.loop) {
+                part.ghosts = true;
+                part.ghost_start = to_local(outline.ghost_start);
+                part.ghost_end = to_local(outline.ghost_end);
+            }
+            shapes.parts.push_back(std::move(part));
+        }
+        // Tag first so the compound body observer sees both when Shapes is set
+        chunk.add<StaticBody>().set<Shapes>(std::move(shapes));
+    }
+
+    std::vector<TileRect> rects;
+    merge_rects(map, range, rects);
+    for (const TileRect &rect : rects) {
+        float width = rect.width * map.tile_size;
+        float height = rect.height * map.tile_size;
+        world.entity()
+            .child_of(chunk)
+            .add<snapshot::Exclude>()
+            .set<Quad>({width, height})
+            .set<Color>({map.color})
+            .set<Position>({origin_x + rect.x * map.tile_size + width / 2.0f,
+                            origin_y + rect.y * map.tile_size + height / 2.0f, 0.0f});
+    }
+
+    return chunk;
+}
+
+static void unload_all(flecs::world world, TileChunks &chunks) {
+    for (auto &[key, chunk] : chunks.loaded) {
+        flecs::entity(world, chunk).destruct();
+    }
+    chunks.loaded.clear();
+}
+
+void set_tile(flecs::entity map_entity, int32_t x, int32_t y, bool solid) {
+    TileMap &map = map_entity.get_mut<TileMap>();
+    if (x < 0 || y < 0 || x >= map.width || y >= map.height) {
+        return;
+    }
+    map.tiles[y * map.width + x] = solid ? 1 : 0;
+
+    TileChunks *chunks = map_entity.try_get_mut<TileChunks>();
+    if (chunks == nullptr) {
+        return;
+    }
+    // Outlines of the chunks around the tile end on its corners, their seams change as well
+    for (int32_t dy = -1; dy <= 1; dy++) {
+        for (int32_t dx = -1; dx <= 1; dx++) {
+            int32_t tile_x = x + dx, tile_y = y + dy;
+            if (tile_x < 0 || tile_y < 0) {
+                continue;
+            }
+            auto it = chunks->loaded.find(
+                chunk_key(tile_x / map.chunk_size, tile_y / map.chunk_size));
+            if (it != chunks->loaded.end()) {
+                flecs::entity(map_entity.world(), it->second).destruct();
+                chunks->loaded.erase(it);
+            }
+        }
+    }
+}
+
+module::module(flecs::world &world) {
+    world.component<TileChunk>().member<int32_t>("x").member<int32_t>("y");
+
+    // Setting a new map throws away everything built from the previous one. Chunks are children of
+    // the map, so deleting the map deletes them too.
+    world.observer<TileMap>().event(flecs::OnSet).each([](flecs::entity e, TileMap &) {
+        unload_all(e.world(), e.ensure<TileChunks>());
+    });
+
+    world.system<const TileMap, TileChunks>("terrain::Stream")
+        .kind(flecs::PreUpdate)
+        .each([](flecs::entity e, const TileMap &map, TileChunks &chunks) {
+            flecs::world world = e.world();
+            Camera camera = world.has<Camera>() ? world.get<Camera>() : Camera{};
+            float extent = map.chunk_size * map.tile_size;
+            int32_t chunks_x = (map.width + map.chunk_size - 1) / map.chunk_size;
+            int32_t chunks_y = (map.height + map.chunk_size - 1) / map.chunk_size;
+
+            auto chunk_coord = [&](float value, float origin) {
+                return (int32_t)std::floor((value - origin) / extent);
+            };
+
+            // Drop chunks that moved well out of range before building the new ones
+            float unload_radius = map.stream_radius * 2.0f;
+            for (auto it = chunks.loaded.begin(); it != chunks.loaded.end();) {
+                flecs::entity entity{world, it->second};
+                if (!entity.is_alive()) {
+                    it = chunks.loaded.erase(it);
+                    continue;
+                }
+                const TileChunk &chunk = entity.get<TileChunk>();
+                float min_x = map.origin_x + chunk.x * extent;
+                float min_y = map.origin_y + chunk.y * extent;
+                bool far = min_x > camera.x + unload_radius ||
+                           min_x + extent < camera.x - unload_radius ||
+                           min_y > camera.y + unload_radius ||
+                           min_y + extent < camera.y - unload_radius;
+                if (far) {
+                    entity.destruct();
+                    it = chunks.loaded.erase(it);
+                } else {
+                    it++;
+                }
+            }
+
+            int32_t min_x = std::max(chunk_coord(camera.x - map.stream_radius, map.origin_x), 0);
+            int32_t min_y = std::max(chunk_coord(camera.y - map.stream_radius, map.origin_y), 0);
+            int32_t max_x =
+                std::min(chunk_coord(camera.x + map.stream_radius, map.origin_x), chunks_x - 1);
+            int32_t max_y =
+                std::min(chunk_coord(camera.y + map.stream_radius, map.origin_y), chunks_y - 1);
+            for (int32_t y = min_y; y <= max_y; y++) {
+                for (int32_t x = min_x; x <= max_x; x++) {
+                    uint64_t key = chunk_key(x, y);
+                    if (chunks.loaded.find(key) == chunks.loaded.end()) {
+                        chunks.loaded[key] = build_chunk(e, map, x, y);
+                    }
+                }
+            }
+        });
+}
+
+} // namespace terrain
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "flecs.h"
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace terrain {
+
+// Grid of solid and empty tiles, built into static chunks around the camera. A chunk collides
+// through chains along the outlines of its solid tiles, open where an outline continues into a
+// neighbouring chunk, and is drawn as one quad per rectangle of merged tiles. A chunk costs a
+// single body no matter how many tiles it has.
+struct TileMap {
+    int32_t width;
+    int32_t height;
+    float tile_size;
+    // World position of the bottom left corner of tile (0, 0), rows go up
+    float origin_x;
+    float origin_y;
+    // Row major from the bottom row, nonzero tiles are solid
+    std::vector<uint8_t> tiles;
+    std::array<float, 4> color = {0.35f, 0.3f, 0.25f, 1.0f};
+    // Chunk edge length in tiles
+    int32_t chunk_size = 16;
+    // Chunks overlapping this distance around the camera are built, chunks outside of twice the
+    // distance are deleted again
+    float stream_radius = 1024.0f;
+
+    bool solid(int32_t x, int32_t y) const {
+        return x >= 0 && y >= 0 && x < width && y < height && tiles[y * width + x] != 0;
+    }
+};
+
+// Chunk entities of a TileMap that are currently built, by chunk coordinate
+struct TileChunks {
+    std::unordered_map<uint64_t, flecs::entity_t> loaded;
+};
+
+// Coordinate of a chunk entity, chunk entities are children of their TileMap
+struct TileChunk {
+    int32_t x;
+    int32_t y;
+};
+
+// Change a tile of a map, the chunk containing it is rebuilt on the next frame
+void set_tile(flecs::entity map, int32_t x, int32_t y, bool solid);
+
+struct module {
+    module(flecs::world &world);
+};
+
+} // namespace terrain